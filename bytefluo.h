@@ -34,8 +34,34 @@
 #include <stdexcept>
 #include <climits>
 #include <cstring>
+#include <functional>
 #include <vector>
 #include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// BYTEFLUO_PREFETCH(p) hints that the memory at p will soon be read
+#if defined(__GNUC__) || defined(__clang__)
+#define BYTEFLUO_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define BYTEFLUO_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char *>(p), _MM_HINT_T0)
+#else
+#define BYTEFLUO_PREFETCH(p) ((void)(p))
+#endif
+
+// BYTEFLUO_HW_CRC32C is defined iff the compiler targets a CPU with a CRC32C instruction
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define BYTEFLUO_HW_CRC32C
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define BYTEFLUO_HW_CRC32C
+#endif
 
 // the bytefluo class throws execptions of class bytefluo_exception
 class bytefluo_exception : public std::runtime_error {
@@ -48,6 +74,13 @@ public:
         attempt_to_read_past_end            = 5,
         attempt_to_seek_after_end           = 6,
         attempt_to_seek_before_beginning    = 7,
+        invalid_utf16                       = 8,
+        output_buffer_too_small             = 9,
+        invalid_encoding                    = 10,
+        seek_not_supported                  = 11,
+        invalid_argument                    = 12,
+        invalid_hash_range                  = 13,
+        io_error                            = 14,
     };
     
     bytefluo_exception(error_id id, const char * msg)
@@ -66,6 +99,125 @@ private:
 };
 
 
+// encode values as keys whose memcmp() order is the natural order of the
+// values, e.g. for building composite keys for a sorted key-value store;
+// the keys may be decoded with the bytefluo read_key() functions
+class bytefluo_key {
+public:
+    enum direction {
+        ascending,  // memcmp() order of keys is the order of the values
+        descending  // memcmp() order of keys is the reverse order of the values
+    };
+
+    // write the sizeof(value) byte key for the integer or floating point
+    // 'value' at 'out'; return a pointer to the byte after the key
+    template <typename value_type>
+    static uint8_t * encode(const value_type & value, uint8_t * out, direction dir = ascending)
+    {
+        typedef typename bits_of_size<sizeof(value_type)>::type bits_type;
+        bits_type bits = traits<value_type>::to_bits(value);
+        if (dir == descending)
+            bits = static_cast<bits_type>(~bits);
+        for (size_t i = 0; i < sizeof(value_type); ++i)
+            out[i] = uint8_t(bits >> ((sizeof(value_type) - 1 - i) * CHAR_BIT));
+        return out + sizeof(value_type);
+    }
+
+    // write the keys for the 'n' values at 'values' consecutively at 'out'
+    template <typename value_type>
+    static uint8_t * encode_array(const value_type * values, size_t n, uint8_t * out,
+        direction dir = ascending)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out = encode(values[i], out, dir);
+        return out;
+    }
+
+    // return the number of bytes encode_string() will write for the 'len'
+    // bytes at 'str'; this is never more than 2 * len + 2
+    static size_t encoded_string_size(const void * str, size_t len)
+    {
+        const uint8_t * p = static_cast<const uint8_t *>(str);
+        size_t zeros = 0;
+        for (size_t i = 0; i < len; ++i)
+            zeros += p[i] == 0;
+        return len + zeros + 2;
+    }
+
+    // write the key for the 'len' bytes at 'str' at 'out'; each 0x00 byte is
+    // escaped as 0x00 0xFF and the key is terminated by 0x00 0x01, so that a
+    // string sorts before any longer string it is a prefix of; return a
+    // pointer to the byte after the key
+    static uint8_t * encode_string(const void * str, size_t len, uint8_t * out,
+        direction dir = ascending)
+    {
+        const uint8_t * p = static_cast<const uint8_t *>(str);
+        const uint8_t flip = dir == descending ? 0xFF : 0x00;
+        for (size_t i = 0; i < len; ++i) {
+            *out++ = uint8_t(p[i] ^ flip);
+            if (p[i] == 0)
+                *out++ = uint8_t(0xFF ^ flip);
+        }
+        *out++ = flip;
+        *out++ = uint8_t(0x01 ^ flip);
+        return out;
+    }
+
+private:
+    friend class bytefluo;
+
+    template <size_t n, typename dummy = void>
+    struct bits_of_size; // leave undefined; all supported sizes are specialisations
+    template <typename dummy> struct bits_of_size<1, dummy> { typedef uint8_t  type; };
+    template <typename dummy> struct bits_of_size<2, dummy> { typedef uint16_t type; };
+    template <typename dummy> struct bits_of_size<4, dummy> { typedef uint32_t type; };
+    template <typename dummy> struct bits_of_size<8, dummy> { typedef uint64_t type; };
+
+    // to_bits() maps a value to an unsigned integer with the same order;
+    // from_bits() is its inverse
+    template <typename value_type, bool is_float = std::is_floating_point<value_type>::value>
+    struct traits {
+        typedef typename bits_of_size<sizeof(value_type)>::type bits_type;
+        static const bits_type sign_bit = static_cast<bits_type>(
+            std::is_signed<value_type>::value ? bits_type(1) << (sizeof(value_type) * CHAR_BIT - 1) : 0);
+
+        // flipping the sign bit puts negative integers before positive ones
+        static bits_type to_bits(value_type value)
+        {
+            return static_cast<bits_type>(static_cast<bits_type>(value) ^ sign_bit);
+        }
+        static value_type from_bits(bits_type bits)
+        {
+            return static_cast<value_type>(static_cast<bits_type>(bits ^ sign_bit));
+        }
+    };
+
+    template <typename value_type>
+    struct traits<value_type, true> {
+        typedef typename bits_of_size<sizeof(value_type)>::type bits_type;
+        static const bits_type sign_bit = static_cast<bits_type>(
+            bits_type(1) << (sizeof(value_type) * CHAR_BIT - 1));
+
+        // IEEE 754 values are sign and magnitude: setting the sign bit of
+        // positive values and inverting all the bits of negative values
+        // puts them all in order
+        static bits_type to_bits(value_type value)
+        {
+            bits_type bits;
+            ::memcpy(&bits, &value, sizeof(bits));
+            return static_cast<bits_type>(bits & sign_bit ? ~bits : bits | sign_bit);
+        }
+        static value_type from_bits(bits_type bits)
+        {
+            bits = static_cast<bits_type>(bits & sign_bit ? bits ^ sign_bit : ~bits);
+            value_type value;
+            ::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+    };
+};
+
+
 // manage specific byte-order read-only access to a given buffer
 class bytefluo {
 public:
@@ -75,6 +227,9 @@ public:
     };
 
 private:
+    friend class bytefluo_stream;
+    friend class bytefluo_decoding_source;
+
     // impl provides compile-time selection of scalar size
     template <typename scalar_type, size_t sizeof_out>
     struct impl; // leave undefined; all supported scalar sizes are specialisations
@@ -169,11 +324,557 @@ private:
         }
     };
 
+    // uint_of_size<n>::type is the unsigned integer type of n bytes
+    template <size_t n, typename dummy = void>
+    struct uint_of_size; // leave undefined; all supported sizes are specialisations
+    template <typename dummy> struct uint_of_size<1, dummy> { typedef uint8_t  type; };
+    template <typename dummy> struct uint_of_size<2, dummy> { typedef uint16_t type; };
+    template <typename dummy> struct uint_of_size<4, dummy> { typedef uint32_t type; };
+    template <typename dummy> struct uint_of_size<8, dummy> { typedef uint64_t type; };
+
+    // return the bytes 'value' would occupy if stored with byte order 'bo',
+    // packed into an unsigned integer of the same size in native byte order;
+    // this may be compared directly with the raw bytes of stored values
+    template <typename scalar_type>
+    static typename uint_of_size<sizeof(scalar_type)>::type
+    to_raw(const scalar_type & value, byte_order bo)
+    {
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        const raw_type v = static_cast<raw_type>(value);
+        uint8_t bytes[sizeof(scalar_type)];
+        for (size_t i = 0; i < sizeof(scalar_type); ++i) {
+            const size_t shift = bo == big ? sizeof(scalar_type) - 1 - i : i;
+            bytes[i] = uint8_t(v >> (shift * CHAR_BIT));
+        }
+        raw_type raw;
+        ::memcpy(&raw, bytes, sizeof(raw));
+        return raw;
+    }
+
+    // return the scalar at 'p' stored with byte order 'bo'
+    template <typename scalar_type, byte_order bo>
+    static scalar_type load(const uint8_t * p)
+    {
+        scalar_type v;
+        if (bo == little)
+            impl<scalar_type, sizeof(scalar_type)>::read_le(v, p);
+        else
+            impl<scalar_type, sizeof(scalar_type)>::read_be(v, p);
+        return v;
+    }
+
+    // sum, min and max of the 'n' scalars at 'p' stored with byte order 'bo';
+    // each loop is a simple reduction that the compiler may vectorise
+    template <typename scalar_type, byte_order bo>
+    static uint64_t sum_of(const uint8_t * p, size_t n)
+    {
+        typedef typename std::conditional<std::is_signed<scalar_type>::value,
+            int64_t, uint64_t>::type wide_type;
+        uint64_t sum = 0; // unsigned, so any overflow wraps harmlessly
+        for (size_t i = 0; i < n; ++i, p += sizeof(scalar_type))
+            sum += static_cast<uint64_t>(static_cast<wide_type>(load<scalar_type, bo>(p)));
+        return sum;
+    }
+
+    template <typename scalar_type, byte_order bo>
+    static scalar_type min_of(const uint8_t * p, size_t n)
+    {
+        scalar_type m = std::numeric_limits<scalar_type>::max();
+        for (size_t i = 0; i < n; ++i, p += sizeof(scalar_type)) {
+            const scalar_type v = load<scalar_type, bo>(p);
+            m = v < m ? v : m;
+        }
+        return m;
+    }
+
+    template <typename scalar_type, byte_order bo>
+    static scalar_type max_of(const uint8_t * p, size_t n)
+    {
+        scalar_type m = std::numeric_limits<scalar_type>::min();
+        for (size_t i = 0; i < n; ++i, p += sizeof(scalar_type)) {
+            const scalar_type v = load<scalar_type, bo>(p);
+            m = v > m ? v : m;
+        }
+        return m;
+    }
+
+    template <typename scalar_type, byte_order bo>
+    static std::pair<scalar_type, scalar_type> minmax_of(const uint8_t * p, size_t n)
+    {
+        scalar_type lo = std::numeric_limits<scalar_type>::max();
+        scalar_type hi = std::numeric_limits<scalar_type>::min();
+        for (size_t i = 0; i < n; ++i, p += sizeof(scalar_type)) {
+            const scalar_type v = load<scalar_type, bo>(p);
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        return std::make_pair(lo, hi);
+    }
+
+    // return the number of bits set in 'x'
+    static unsigned popcount(uint64_t x)
+    {
+        x = x - (x >> 1 & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + (x >> 2 & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return unsigned(x * 0x0101010101010101ULL >> 56);
+    }
+
+    // predicates for select_of(): is the scalar stored at 'p' in [lo, hi]?
+    template <typename scalar_type, byte_order bo>
+    struct in_range {
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        raw_type lo, width;
+        in_range(scalar_type lo, scalar_type hi)
+        : lo(static_cast<raw_type>(lo)),
+          width(static_cast<raw_type>(static_cast<raw_type>(hi) - static_cast<raw_type>(lo)))
+        {
+        }
+        bool operator()(const uint8_t * p) const
+        {
+            // biasing by lo turns the two compares into one unsigned compare
+            const raw_type v = static_cast<raw_type>(load<scalar_type, bo>(p));
+            return static_cast<raw_type>(v - lo) <= width;
+        }
+    };
+
+    // ...does the scalar stored at 'p' have the given raw bytes (or not)?
+    template <typename raw_type>
+    struct raw_equal {
+        raw_type needle;
+        bool want_equal;
+        raw_equal(raw_type needle, bool want_equal) : needle(needle), want_equal(want_equal) {}
+        bool operator()(const uint8_t * p) const
+        {
+            raw_type v;
+            ::memcpy(&v, p, sizeof(v));
+            return (v == needle) == want_equal;
+        }
+    };
+
+    // set bit i % 64 of bitmap[i / 64] iff 'pred' is true for the i-th of the
+    // 'n' scalars at 'p', clearing the unused bits of the last word; return
+    // the number of bits set
+    template <typename scalar_type, typename pred_type>
+    static size_t select_of(const uint8_t * p, size_t n, const pred_type & pred, uint64_t * bitmap)
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i += 64) {
+            const size_t m = n - i < 64 ? n - i : 64;
+            uint64_t word = 0;
+            for (size_t j = 0; j < m; ++j, p += sizeof(scalar_type))
+                word |= uint64_t(pred(p)) << j;
+            *bitmap++ = word;
+            count += popcount(word);
+        }
+        return count;
+    }
+
+    // read the scalars at the 'n' given offsets from 'base', prefetching the
+    // scalar 'distance' offsets ahead so that the cache misses overlap
+    template <typename scalar_type, byte_order bo>
+    static void gather_of(const uint8_t * base, const size_t * offsets, size_t n,
+        scalar_type * out, size_t distance)
+    {
+        size_t i = 0;
+        if (distance) {
+            for (; i < n && i < distance; ++i)
+                BYTEFLUO_PREFETCH(base + offsets[i]);
+            for (i = 0; n - i > distance; ++i) {
+                BYTEFLUO_PREFETCH(base + offsets[i + distance]);
+                out[i] = load<scalar_type, bo>(base + offsets[i]);
+            }
+        }
+        for (; i < n; ++i)
+            out[i] = load<scalar_type, bo>(base + offsets[i]);
+    }
+
+    // return the number of the 'n' sorted scalars at 'p' that are less than
+    // 'key'; rather than binary search, first count the groups of 16 scalars
+    // whose last member is less than 'key', then count the scalars less than
+    // 'key' in the group after those; both loops are branch-free counts
+    template <typename scalar_type, byte_order bo>
+    static size_t block_lower_bound_of(const uint8_t * p, size_t n, const scalar_type & key)
+    {
+        const size_t k = 16;
+        size_t groups = 0;
+        for (size_t i = k - 1; i < n; i += k)
+            groups += load<scalar_type, bo>(p + i * sizeof(scalar_type)) < key;
+        const size_t first = groups * k;
+        const size_t last = n - first < k ? n : first + k;
+        size_t count = first;
+        for (size_t i = first; i < last; ++i)
+            count += load<scalar_type, bo>(p + i * sizeof(scalar_type)) < key;
+        return count;
+    }
+
+    // check that a scalar of 'elem_size' bytes lies at each of the 'n' offsets
+    void check_offsets(const size_t * offsets, size_t n, size_t elem_size) const
+    {
+        const size_t siz = static_cast<size_t>(buf_end - buf_begin);
+        const size_t limit = siz < elem_size ? 0 : siz - elem_size + 1;
+        bool bad = false;
+        for (size_t i = 0; i < n; ++i)
+            bad |= offsets[i] >= limit;
+        if (bad)
+            throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+    }
+
+    static uint64_t rotl64(uint64_t x, int r)
+    {
+        return x << r | x >> (64 - r);
+    }
+
+    // mix the little-endian 64-bit value at 'p' into XXH64 accumulator 'acc'
+    static uint64_t hash64_round(uint64_t acc, const uint8_t * p)
+    {
+        uint64_t input;
+        impl<uint64_t, 8>::read_le(input, p);
+        acc += input * 0xC2B2AE3D27D4EB4FULL;
+        return rotl64(acc, 31) * 0x9E3779B185EBCA87ULL;
+    }
+
+    // tables for slicing-by-8 CRC calculation: t[0] is the usual byte-at-a-time
+    // table and t[k][i] is the CRC of byte i followed by k zero bytes
+    struct crc_tables {
+        uint32_t t[8][256];
+        explicit crc_tables(uint32_t poly)
+        {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = c & 1 ? c >> 1 ^ poly : c >> 1;
+                t[0][i] = c;
+            }
+            for (int k = 1; k < 8; ++k)
+                for (int i = 0; i < 256; ++i)
+                    t[k][i] = t[k - 1][i] >> 8 ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    };
+
+    // return the CRC of the 'len' bytes at 'p' continuing from 'crc'
+    static uint32_t crc_of(const uint8_t * p, size_t len, uint32_t poly, uint32_t crc)
+    {
+        crc = ~crc;
+#if defined(BYTEFLUO_HW_CRC32C)
+        if (poly == crc32c_poly) {
+            for (; len >= 8; len -= 8, p += 8) {
+                uint64_t v;
+                ::memcpy(&v, p, 8); // the instruction requires little-endian data
+# if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+                crc = uint32_t(_mm_crc32_u64(crc, v));
+# elif defined(__SSE4_2__)
+                crc = _mm_crc32_u32(_mm_crc32_u32(crc, uint32_t(v)), uint32_t(v >> 32));
+# else
+                crc = __crc32cd(crc, v);
+# endif
+            }
+        }
+#endif
+        if (len >= 8) {
+            // only the tables for the two standard polynomials are kept;
+            // tables for any other polynomial are recalculated every time
+            static const crc_tables crc32_tables(crc32_poly);
+            static const crc_tables crc32c_tables(crc32c_poly);
+            if (poly == crc32_poly)
+                crc = slice_by_8(crc32_tables, p, len, crc);
+            else if (poly == crc32c_poly)
+                crc = slice_by_8(crc32c_tables, p, len, crc);
+            else
+                crc = slice_by_8(crc_tables(poly), p, len, crc);
+            p += len & ~size_t(7);
+            len &= 7;
+        }
+        for (; len; --len, ++p) {
+            crc ^= *p;
+            for (int k = 0; k < 8; ++k)
+                crc = crc & 1 ? crc >> 1 ^ poly : crc >> 1;
+        }
+        return ~crc;
+    }
+
+    // process the whole 8-byte blocks of the 'len' bytes at 'p'
+    static uint32_t slice_by_8(const crc_tables & tables, const uint8_t * p, size_t len, uint32_t crc)
+    {
+        const uint32_t (* const t)[256] = tables.t;
+        for (; len >= 8; len -= 8, p += 8) {
+            uint32_t lo, hi;
+            impl<uint32_t, 4>::read_le(lo, p);
+            impl<uint32_t, 4>::read_le(hi, p + 4);
+            lo ^= crc;
+            crc = t[7][lo & 0xFF] ^ t[6][lo >> 8 & 0xFF] ^ t[5][lo >> 16 & 0xFF] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xFF] ^ t[2][hi >> 8 & 0xFF] ^ t[1][hi >> 16 & 0xFF] ^ t[0][hi >> 24];
+        }
+        return crc;
+    }
+
+    static uint32_t gf2_matrix_times(const uint32_t * mat, uint32_t vec)
+    {
+        uint32_t sum = 0;
+        for (; vec; vec >>= 1, ++mat)
+            if (vec & 1)
+                sum ^= *mat;
+        return sum;
+    }
+
+    static void gf2_matrix_square(uint32_t * square, const uint32_t * mat)
+    {
+        for (int n = 0; n < 32; ++n)
+            square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+
+    // set out[i] to dict[index i] for the 'n' indices at 'p' stored with
+    // byte order 'bo', after checking that all the indices are valid
+    template <typename index_type, byte_order bo, typename value_type>
+    static void dictionary_of(const uint8_t * p, size_t n, const value_type * dict,
+        size_t dict_size, value_type * out)
+    {
+        // finding the largest index is a vectorisable reduction, so checking
+        // every index up front is cheaper than a branch in the decode loop,
+        // which is then a plain table lookup the compiler may turn into
+        // vector gathers
+        typedef typename uint_of_size<sizeof(index_type)>::type raw_type;
+        if (n && max_of<raw_type, bo>(p, n) >= dict_size)
+            throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                "bytefluo: dictionary index out of range");
+        for (size_t i = 0; i < n; ++i, p += sizeof(raw_type))
+            out[i] = dict[load<raw_type, bo>(p)];
+    }
+
+    // expand the run-length encoded pairs starting at 'p' into the 'n'
+    // values at 'out'; return the address following the last pair used
+    template <typename count_type, typename value_type, byte_order bo>
+    static const uint8_t * rle_of(const uint8_t * p, const uint8_t * end,
+        value_type * out, size_t n)
+    {
+        typedef typename uint_of_size<sizeof(count_type)>::type raw_count_type;
+        const size_t pair_size = sizeof(count_type) + sizeof(value_type);
+        size_t i = 0;
+        while (i < n) {
+            if (static_cast<size_t>(end - p) < pair_size)
+                throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                    "bytefluo: attempt to read past end of data");
+            const uint64_t count = load<raw_count_type, bo>(p);
+            if (count > n - i)
+                throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                    "bytefluo: run-length encoded run too long");
+            // fill_n() becomes a memset() or wide vector stores for long runs
+            std::fill_n(out + i, static_cast<size_t>(count),
+                load<value_type, bo>(p + sizeof(count_type)));
+            i += static_cast<size_t>(count);
+            p += pair_size;
+        }
+        return p;
+    }
+
+    // return the offset of the first of the 'len' bytes at 'a' and 'b' that
+    // differ, or 'len' if none differ
+    static size_t mismatch_of(const uint8_t * a, const uint8_t * b, size_t len)
+    {
+        // test 64 bytes per branch by OR-ing the XOR of eight word pairs,
+        // which the compiler can turn into wide vector compares; only the
+        // block holding the first difference is then scanned word by word
+        size_t i = 0;
+        for (; len - i >= 64; i += 64) {
+            uint64_t x[8], y[8];
+            ::memcpy(x, a + i, 64);
+            ::memcpy(y, b + i, 64);
+            uint64_t diff = 0;
+            for (int k = 0; k < 8; ++k)
+                diff |= x[k] ^ y[k];
+            if (diff)
+                break;
+        }
+        for (; len - i >= 8; i += 8) {
+            uint64_t x, y;
+            ::memcpy(&x, a + i, 8);
+            ::memcpy(&y, b + i, 8);
+            if (x != y)
+                break;
+        }
+        while (i < len && a[i] == b[i])
+            ++i;
+        return i;
+    }
+
+    // return the Internet checksum of the 'len' bytes at 'p' with given 'seed'
+    static uint16_t inet_checksum_of(const uint8_t * p, size_t len, uint32_t seed)
+    {
+        // the one's complement sum doesn't depend on byte order (RFC 1071
+        // section 2(B)), so sum native 32-bit words in 64-bit accumulators,
+        // which won't overflow for any practical length, and swap the bytes
+        // of the folded result if this computer is little-endian; a loop
+        // adding one word to one accumulator is one the compiler vectorises
+        uint64_t a = 0;
+        for (; len >= 4; len -= 4, p += 4) {
+            uint32_t w;
+            ::memcpy(&w, p, 4);
+            a += w;
+        }
+        uint8_t tail[4] = { 0, 0, 0, 0 };
+        if (len)
+            ::memcpy(tail, p, len);
+        uint32_t w;
+        ::memcpy(&w, tail, 4);
+        a += w;
+
+        while (a >> 16)
+            a = (a & 0xFFFF) + (a >> 16);
+        const uint16_t one = 1;
+        uint8_t first_byte;
+        ::memcpy(&first_byte, &one, 1);
+        if (first_byte) // little-endian
+            a = (a & 0xFF) << 8 | a >> 8;
+
+        a += seed;
+        while (a >> 16)
+            a = (a & 0xFFFF) + (a >> 16);
+        return static_cast<uint16_t>(~a);
+    }
+
+    // check that 'n' elements of 'elem_size' bytes lie between cursor and end
+    void check_elements(size_t n, size_t elem_size) const
+    {
+        if (n > static_cast<size_t>(buf_end - cursor) / elem_size)
+            throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+    }
+
 
 public:
+    // find_value() result when the value is not found
+    static const size_t npos = SIZE_MAX;
+
+    // random-access read-only view of an array of integer scalars stored with
+    // byte order 'bo'; a scalar is decoded only when it is accessed, and
+    // every access is checked against the bounds of the array
+    template <typename scalar_type, byte_order bo>
+    class array_view {
+    public:
+        typedef scalar_type value_type;
+
+        class iterator {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef scalar_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const scalar_type * pointer;
+            typedef scalar_type reference; // scalars are returned by value
+
+            iterator() : first(0), n(0), i(0) {}
+
+            scalar_type operator*() const { return get(first, n, i); }
+            scalar_type operator[](difference_type d) const { return get(first, n, i + d); }
+
+            iterator & operator++() { ++i; return *this; }
+            iterator & operator--() { --i; return *this; }
+            iterator operator++(int) { iterator t(*this); ++i; return t; }
+            iterator operator--(int) { iterator t(*this); --i; return t; }
+            iterator & operator+=(difference_type d) { i += d; return *this; }
+            iterator & operator-=(difference_type d) { i -= d; return *this; }
+            iterator operator+(difference_type d) const { return iterator(first, n, i + d); }
+            iterator operator-(difference_type d) const { return iterator(first, n, i - d); }
+            friend iterator operator+(difference_type d, const iterator & it) { return it + d; }
+            difference_type operator-(const iterator & rhs) const
+            {
+                return static_cast<difference_type>(i - rhs.i);
+            }
+
+            bool operator==(const iterator & rhs) const { return i == rhs.i; }
+            bool operator!=(const iterator & rhs) const { return i != rhs.i; }
+            bool operator<(const iterator & rhs) const
+            {
+                return static_cast<difference_type>(i - rhs.i) < 0;
+            }
+            bool operator>(const iterator & rhs) const { return rhs < *this; }
+            bool operator<=(const iterator & rhs) const { return !(rhs < *this); }
+            bool operator>=(const iterator & rhs) const { return !(*this < rhs); }
+
+        private:
+            friend class array_view;
+            iterator(const uint8_t * first, size_t n, size_t i) : first(first), n(n), i(i) {}
+
+            const uint8_t * first;
+            size_t n;
+            size_t i;   // index of the scalar referenced; may be outside [0, n]
+        };
+
+        // empty view
+        array_view() : first(0), n(0) {}
+
+        // view the 'n' scalars at 'begin'
+        array_view(const void * begin, size_t n)
+        : first(static_cast<const uint8_t *>(begin)), n(n)
+        {
+            validate(begin, first + n * sizeof(scalar_type));
+        }
+
+        iterator begin() const { return iterator(first, n, 0); }
+        iterator end() const { return iterator(first, n, n); }
+        size_t size() const { return n; }
+        bool empty() const { return n == 0; }
+
+        // return the scalar at index 'i'
+        scalar_type operator[](size_t i) const { return get(first, n, i); }
+
+        // return the index of the first scalar not less than 'key', or size()
+        // if there is none; the array must be sorted in ascending order; the
+        // loop has a fixed trip count and no data-dependent branches
+        size_t lower_bound(const scalar_type & key) const
+        {
+            if (n == 0)
+                return 0;
+            size_t base = 0;
+            size_t len = n;
+            while (len > 1) {
+                const size_t half = len / 2;
+                base = decode(first + (base + half) * sizeof(scalar_type)) < key
+                    ? base + half : base;
+                len -= half;
+            }
+            return base + (decode(first + base * sizeof(scalar_type)) < key);
+        }
+
+        // return the index of the first scalar not less than 'key', or npos
+        // if there is none; the array must be in Eytzinger (breadth-first
+        // binary tree) order, where the children of the scalar at index i
+        // are at 2i + 1 and 2i + 2; the first few levels of the tree share
+        // a few cache lines, which makes searches of large arrays faster
+        size_t eytzinger_lower_bound(const scalar_type & key) const
+        {
+            size_t k = 1; // k is the 1-based index of the current node
+            while (k <= n)
+                k = 2 * k + (decode(first + (k - 1) * sizeof(scalar_type)) < key);
+            // strip the right turns taken after the last left turn
+            while (k & 1)
+                k >>= 1;
+            k >>= 1;
+            return k ? k - 1 : npos;
+        }
+
+    private:
+        const uint8_t * first;
+        size_t n;
+
+        static scalar_type decode(const uint8_t * p)
+        {
+            return load<scalar_type, bo>(p);
+        }
+
+        static scalar_type get(const uint8_t * first, size_t n, size_t i)
+        {
+            if (i >= n)
+                throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                    "bytefluo: attempt to read past end of data");
+            return decode(first + i * sizeof(scalar_type));
+        }
+    };
+
     // default to empty range [0, 0), big-endian
     bytefluo()
-    : buf_begin(0), buf_end(0), cursor(0), buf_byte_order(big)
+    : buf_begin(0), buf_end(0), cursor(0), buf_byte_order(big), hash_begin(0),
+      hashing(false)
     {
     }
     
@@ -186,7 +887,9 @@ public:
     : buf_begin(static_cast<const uint8_t *>(begin)),
       buf_end  (static_cast<const uint8_t *>(end)),
       cursor   (static_cast<const uint8_t *>(begin)),
-      buf_byte_order(bo)
+      buf_byte_order(bo),
+      hash_begin(0),
+      hashing(false)
     {
         validate(begin, end);
         if (buf_byte_order != big && buf_byte_order != little)
@@ -201,6 +904,8 @@ public:
         cursor    =
         buf_begin = static_cast<const uint8_t *>(begin);
         buf_end   = static_cast<const uint8_t *>(end);
+        hash_begin = 0;
+        hashing = false;
         return *this;
     }
     
@@ -269,88 +974,744 @@ public:
         return *this;
     }
 
-    // move cursor 'pos' bytes from stream beginning
-    size_t seek_begin(size_t pos)
+    // convert 'code_units' UTF-16 code units at current cursor position,
+    // stored with byte order 'bo', to UTF-8 in the 'dest_len' bytes at 'dest';
+    // return the number of bytes written to 'dest' (no terminating 0 is added)
+    size_t read_utf16(char * dest, size_t dest_len, size_t code_units, byte_order bo)
     {
-        if (pos > static_cast<size_t>(buf_end - buf_begin))
+        if (code_units > static_cast<size_t>(buf_end - cursor) / 2)
             throw bytefluo_exception(
-                bytefluo_exception::attempt_to_seek_after_end,
-                "bytefluo: attempt to seek after end of data");
-        cursor = buf_begin + pos;
-        return static_cast<size_t>(cursor - buf_begin);
+                bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+        if (bo != big && bo != little)
+            throw bytefluo_exception(bytefluo_exception::invalid_byte_order,
+                "bytefluo: invalid byte order");
+
+        // hi is the offset of the most significant byte within each code unit
+        const size_t hi = bo == big ? 0 : 1;
+        const size_t lo = 1 - hi;
+
+        // a code unit is ASCII iff its high byte is 0 and its low byte < 0x80
+        static const uint8_t ascii_test_be[8] = {
+            0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80
+        };
+        static const uint8_t ascii_test_le[8] = {
+            0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF
+        };
+        uint64_t ascii_test;
+        ::memcpy(&ascii_test, bo == big ? ascii_test_be : ascii_test_le, 8);
+
+        const uint8_t * p = cursor;
+        const uint8_t * const p_end = cursor + code_units * 2;
+        uint8_t * out = reinterpret_cast<uint8_t *>(dest);
+        uint8_t * const out_end = out + dest_len;
+        while (p != p_end) {
+            // fast path: test four code units at once and copy them
+            // straight through if they are all ASCII
+            if (p_end - p >= 8 && out_end - out >= 4) {
+                uint64_t units;
+                ::memcpy(&units, p, 8);
+                if ((units & ascii_test) == 0) {
+                    out[0] = p[lo];
+                    out[1] = p[lo + 2];
+                    out[2] = p[lo + 4];
+                    out[3] = p[lo + 6];
+                    p += 8;
+                    out += 4;
+                    continue;
+                }
+            }
+
+            uint32_t c = uint32_t(p[hi]) << CHAR_BIT | uint32_t(p[lo]);
+            p += 2;
+            if ((c & 0xF800) == 0xD800) { // surrogate
+                if (c >= 0xDC00 || p == p_end)
+                    throw bytefluo_exception(bytefluo_exception::invalid_utf16,
+                        "bytefluo: unpaired UTF-16 surrogate");
+                const uint32_t c2 = uint32_t(p[hi]) << CHAR_BIT | uint32_t(p[lo]);
+                if ((c2 & 0xFC00) != 0xDC00)
+                    throw bytefluo_exception(bytefluo_exception::invalid_utf16,
+                        "bytefluo: unpaired UTF-16 surrogate");
+                p += 2;
+                c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+            }
+
+            const ptrdiff_t n = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+            if (out_end - out < n)
+                throw bytefluo_exception(
+                    bytefluo_exception::output_buffer_too_small,
+                    "bytefluo: output buffer too small");
+            switch (n) {
+            case 1:
+                out[0] = uint8_t(c);
+                break;
+            case 2:
+                out[0] = uint8_t(0xC0 | c >> 6);
+                out[1] = uint8_t(0x80 | (c & 0x3F));
+                break;
+            case 3:
+                out[0] = uint8_t(0xE0 | c >> 12);
+                out[1] = uint8_t(0x80 | (c >> 6 & 0x3F));
+                out[2] = uint8_t(0x80 | (c & 0x3F));
+                break;
+            default:
+                out[0] = uint8_t(0xF0 | c >> 18);
+                out[1] = uint8_t(0x80 | (c >> 12 & 0x3F));
+                out[2] = uint8_t(0x80 | (c >> 6 & 0x3F));
+                out[3] = uint8_t(0x80 | (c & 0x3F));
+                break;
+            }
+            out += n;
+        }
+
+        cursor = p_end;
+        return static_cast<size_t>(out - reinterpret_cast<uint8_t *>(dest));
     }
 
-    // move cursor 'pos' bytes from current position
-    size_t seek_current(long pos)
+    // as read_utf16(), but the length of the UTF-16 data is given in bytes
+    size_t read_utf16_bytes(char * dest, size_t dest_len, size_t byte_len, byte_order bo)
     {
-        if (pos < 0) { // seek backward
-            if (pos < static_cast<long>(buf_begin - cursor))
-                throw bytefluo_exception(
-                    bytefluo_exception::attempt_to_seek_before_beginning,
-                    "bytefluo: attempt to seek before beginning of data");
+        if (byte_len % 2)
+            throw bytefluo_exception(bytefluo_exception::invalid_utf16,
+                "bytefluo: odd UTF-16 byte length");
+        return read_utf16(dest, dest_len, byte_len / 2, bo);
+    }
+
+    // return the index, relative to the cursor, of the first of the 'n'
+    // scalars at the cursor that equals 'value', or npos if none does;
+    // the scalars are assumed to have byte order buf_byte_order
+    template <typename scalar_type>
+    size_t find_value(const scalar_type & value, size_t n) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        const raw_type needle = to_raw(value, buf_byte_order);
+
+        // compare the stored bytes directly with the needle, which has been
+        // put in the stored byte order once; count the matches in each block
+        // of 64 scalars with a loop free of branches, like count_value(),
+        // which the compiler can vectorise, and look for the first match
+        // only in a block where there is one
+        const size_t block = 64;
+        const uint8_t * p = cursor;
+        size_t i = 0;
+        for (; n - i >= block; i += block, p += block * sizeof(raw_type)) {
+            size_t hits = 0;
+            for (size_t j = 0; j < block; ++j) {
+                raw_type v;
+                ::memcpy(&v, p + j * sizeof(raw_type), sizeof(v));
+                hits += v == needle;
+            }
+            if (hits)
+                break;
         }
-        else { // seek forward (or nowhere)
-            if (pos > static_cast<long>(buf_end - cursor))
-                throw bytefluo_exception(
-                    bytefluo_exception::attempt_to_seek_after_end,
-                    "bytefluo: attempt to seek after end of data");
+        for (; i < n; ++i, p += sizeof(raw_type)) {
+            raw_type v;
+            ::memcpy(&v, p, sizeof(v));
+            if (v == needle)
+                return i;
         }
-        cursor += pos;
-        return static_cast<size_t>(cursor - buf_begin);
+        return npos;
     }
 
-    // move cursor 'pos' bytes from stream end
-    size_t seek_end(size_t pos)
+    // as above, but search all the whole scalars between cursor and end
+    template <typename scalar_type>
+    size_t find_value(const scalar_type & value) const
     {
-        if (pos > static_cast<size_t>(buf_end - buf_begin))
-            throw bytefluo_exception(
-                bytefluo_exception::attempt_to_seek_before_beginning,
-                "bytefluo: attempt to seek before beginning of data");
-        cursor = buf_end - pos;
-        return static_cast<size_t>(cursor - buf_begin);
+        return find_value(value, static_cast<size_t>(buf_end - cursor) / sizeof(scalar_type));
     }
 
-    // return true iff cursor is at end of stream
-    bool eos() const
+    // return the number of the 'n' scalars at the cursor that equal 'value';
+    // the scalars are assumed to have byte order buf_byte_order
+    template <typename scalar_type>
+    size_t count_value(const scalar_type & value, size_t n) const
     {
-        return cursor == buf_end;
+        check_elements(n, sizeof(scalar_type));
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        const raw_type needle = to_raw(value, buf_byte_order);
+        const uint8_t * p = cursor;
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i, p += sizeof(raw_type)) {
+            raw_type v;
+            ::memcpy(&v, p, sizeof(v));
+            count += v == needle;
+        }
+        return count;
     }
 
-    // return number of bytes in stream
-    size_t size() const
+    // as above, but count all the whole scalars between cursor and end
+    template <typename scalar_type>
+    size_t count_value(const scalar_type & value) const
     {
-        return static_cast<size_t>(buf_end - buf_begin);
+        return count_value(value, static_cast<size_t>(buf_end - cursor) / sizeof(scalar_type));
     }
 
-    // return distance from buffer start to cursor
-    size_t tellg() const
+    // return the sum of the 'n' scalars at the cursor, which are assumed to
+    // have byte order buf_byte_order; the sum is accumulated in 64 bits, so
+    // it will not overflow for scalars smaller than 64 bits
+    template <typename scalar_type>
+    typename std::conditional<std::is_signed<scalar_type>::value, int64_t, uint64_t>::type
+    reduce_sum(size_t n) const
     {
-        return static_cast<size_t>(cursor - buf_begin);
+        typedef typename std::conditional<std::is_signed<scalar_type>::value,
+            int64_t, uint64_t>::type wide_type;
+        check_elements(n, sizeof(scalar_type));
+        return static_cast<wide_type>(buf_byte_order == little
+            ? sum_of<scalar_type, little>(cursor, n)
+            : sum_of<scalar_type, big>(cursor, n));
     }
-    
-private:
-    const uint8_t * buf_begin;
-    const uint8_t * buf_end;
-    const uint8_t * cursor;
-    byte_order buf_byte_order;
 
-    // throw an exception if given buffer limits are obviously bad
-    void validate(const void * begin, const void * end)
+    // return the smallest of the 'n' scalars at the cursor, which are assumed
+    // to have byte order buf_byte_order; return the largest possible
+    // scalar_type value if 'n' is 0
+    template <typename scalar_type>
+    scalar_type reduce_min(size_t n) const
     {
-        if (begin == 0 && end != 0)
-            throw bytefluo_exception(
-                bytefluo_exception::null_begin_non_null_end,
-                "bytefluo: begin is 0, end isn't");
-        if (begin != 0 && end == 0)
-            throw bytefluo_exception(
-                bytefluo_exception::null_end_non_null_begin,
-                "bytefluo: end is 0, begin isn't");
-        if (end < begin)
-            throw bytefluo_exception(
-                bytefluo_exception::end_precedes_begin,
-                "bytefluo: end precedes begin");
+        check_elements(n, sizeof(scalar_type));
+        return buf_byte_order == little
+            ? min_of<scalar_type, little>(cursor, n)
+            : min_of<scalar_type, big>(cursor, n);
     }
-};
+
+    // return the largest of the 'n' scalars at the cursor, which are assumed
+    // to have byte order buf_byte_order; return the smallest possible
+    // scalar_type value if 'n' is 0
+    template <typename scalar_type>
+    scalar_type reduce_max(size_t n) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        return buf_byte_order == little
+            ? max_of<scalar_type, little>(cursor, n)
+            : max_of<scalar_type, big>(cursor, n);
+    }
+
+    // return reduce_min() and reduce_max() of the 'n' scalars at the cursor,
+    // calculated in a single pass
+    template <typename scalar_type>
+    std::pair<scalar_type, scalar_type> reduce_minmax(size_t n) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        return buf_byte_order == little
+            ? minmax_of<scalar_type, little>(cursor, n)
+            : minmax_of<scalar_type, big>(cursor, n);
+    }
+
+    // set bit i % 64 of bitmap[i / 64] iff the i-th of the 'n' scalars at the
+    // cursor is in [lo, hi]; the scalars are assumed to have byte order
+    // buf_byte_order; 'bitmap' must have room for (n + 63) / 64 words;
+    // return the number of scalars selected
+    template <typename scalar_type>
+    size_t scan_range(size_t n, scalar_type lo, scalar_type hi, uint64_t * bitmap) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        if (hi < lo) {
+            std::fill(bitmap, bitmap + (n + 63) / 64, uint64_t(0));
+            return 0;
+        }
+        return buf_byte_order == little
+            ? select_of<scalar_type>(cursor, n, in_range<scalar_type, little>(lo, hi), bitmap)
+            : select_of<scalar_type>(cursor, n, in_range<scalar_type, big>(lo, hi), bitmap);
+    }
+
+    // as scan_range(), but select scalars equal to 'value'; the scalars are
+    // compared without being decoded
+    template <typename scalar_type>
+    size_t scan_equal(size_t n, scalar_type value, uint64_t * bitmap) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        return select_of<scalar_type>(cursor, n,
+            raw_equal<raw_type>(to_raw(value, buf_byte_order), true), bitmap);
+    }
+
+    // as scan_range(), but select scalars not equal to 'value'; the scalars
+    // are compared without being decoded
+    template <typename scalar_type>
+    size_t scan_not_equal(size_t n, scalar_type value, uint64_t * bitmap) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        typedef typename uint_of_size<sizeof(scalar_type)>::type raw_type;
+        return select_of<scalar_type>(cursor, n,
+            raw_equal<raw_type>(to_raw(value, buf_byte_order), false), bitmap);
+    }
+
+    // read into out[i] the big-endian scalar at offsets[i] bytes from the
+    // buffer beginning, for i in [0, n); every offset is checked before any
+    // scalar is read; the scalar 'prefetch_distance' offsets ahead is
+    // prefetched so that independent cache misses overlap
+    template <typename scalar_type>
+    void gather_be(const size_t * offsets, size_t n, scalar_type * out,
+        size_t prefetch_distance = 16) const
+    {
+        check_offsets(offsets, n, sizeof(scalar_type));
+        gather_of<scalar_type, big>(buf_begin, offsets, n, out, prefetch_distance);
+    }
+
+    // as gather_be(), but the scalars are little-endian
+    template <typename scalar_type>
+    void gather_le(const size_t * offsets, size_t n, scalar_type * out,
+        size_t prefetch_distance = 16) const
+    {
+        check_offsets(offsets, n, sizeof(scalar_type));
+        gather_of<scalar_type, little>(buf_begin, offsets, n, out, prefetch_distance);
+    }
+
+    // return the index of the first of the 'count' scalars at the cursor that
+    // is not less than 'key', or 'count' if there is none; the scalars must be
+    // sorted in ascending order and are assumed to have byte order
+    // buf_byte_order; intended for small blocks of keys, such as index pages
+    template <typename scalar_type>
+    size_t block_lower_bound(size_t count, const scalar_type & key) const
+    {
+        check_elements(count, sizeof(scalar_type));
+        return buf_byte_order == little
+            ? block_lower_bound_of<scalar_type, little>(cursor, count, key)
+            : block_lower_bound_of<scalar_type, big>(cursor, count, key);
+    }
+
+    // return a view of the 'n' big-endian scalars at the cursor
+    template <typename scalar_type>
+    array_view<scalar_type, big> be_array(size_t n) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        return array_view<scalar_type, big>(cursor, n);
+    }
+
+    // return a view of the 'n' little-endian scalars at the cursor
+    template <typename scalar_type>
+    array_view<scalar_type, little> le_array(size_t n) const
+    {
+        check_elements(n, sizeof(scalar_type));
+        return array_view<scalar_type, little>(cursor, n);
+    }
+
+    // read 'n' dictionary indices of type index_type from current cursor
+    // position and set out[i] to dict[index i]; the indices are assumed to
+    // have byte order buf_byte_order and are treated as unsigned; if any
+    // index is not less than 'dict_size' throw invalid_encoding before
+    // anything is written to 'out' or the cursor is moved
+    template <typename index_type, typename value_type>
+    bytefluo & decode_dictionary(size_t n, const value_type * dict, size_t dict_size,
+        value_type * out)
+    {
+        check_elements(n, sizeof(index_type));
+        if (buf_byte_order == little)
+            dictionary_of<index_type, little>(cursor, n, dict, dict_size, out);
+        else
+            dictionary_of<index_type, big>(cursor, n, dict, dict_size, out);
+        cursor += n * sizeof(index_type);
+        return *this;
+    }
+
+    // read (count, value) pairs, each a count_type run length followed by a
+    // value_type integer scalar value, from current cursor position and write each value
+    // 'count' times to 'out' until 'n' values have been written; the pairs
+    // are assumed to have byte order buf_byte_order; if a run would write
+    // past out[n - 1] throw invalid_encoding; on any exception the cursor is
+    // not moved, though some of 'out' may have been written
+    template <typename count_type, typename value_type>
+    bytefluo & decode_rle(value_type * out, size_t n)
+    {
+        const uint8_t * p = buf_byte_order == little
+            ? rle_of<count_type, value_type, little>(cursor, buf_end, out, n)
+            : rle_of<count_type, value_type, big>(cursor, buf_end, out, n);
+        cursor = p;
+        return *this;
+    }
+
+    // read an integer or floating point value from the key written by
+    // bytefluo_key::encode() at current cursor position
+    template <typename value_type>
+    bytefluo & read_key(value_type & out, bytefluo_key::direction dir = bytefluo_key::ascending)
+    {
+        return read_keys(&out, 1, dir);
+    }
+
+    // read 'n' values from the consecutive keys written by
+    // bytefluo_key::encode_array() at current cursor position
+    template <typename value_type>
+    bytefluo & read_keys(value_type * out, size_t n,
+        bytefluo_key::direction dir = bytefluo_key::ascending)
+    {
+        typedef typename bytefluo_key::bits_of_size<sizeof(value_type)>::type bits_type;
+        check_elements(n, sizeof(value_type));
+        const bits_type flip = static_cast<bits_type>(dir == bytefluo_key::descending ? ~bits_type(0) : 0);
+        for (size_t i = 0; i < n; ++i, cursor += sizeof(value_type)) {
+            bits_type bits;
+            impl<bits_type, sizeof(bits_type)>::read_be(bits, cursor);
+            out[i] = bytefluo_key::traits<value_type>::from_bits(static_cast<bits_type>(bits ^ flip));
+        }
+        return *this;
+    }
+
+    // read the string from the key written by bytefluo_key::encode_string()
+    // at current cursor position into the 'dest_len' bytes at 'dest'; return
+    // the length of the string; the cursor is advanced past the key
+    size_t read_key_string(void * dest, size_t dest_len,
+        bytefluo_key::direction dir = bytefluo_key::ascending)
+    {
+        const uint8_t flip = dir == bytefluo_key::descending ? 0xFF : 0x00;
+        const uint8_t * p = cursor;
+        uint8_t * out = static_cast<uint8_t *>(dest);
+        size_t len = 0;
+        for (;;) {
+            // copy the run of bytes up to the next escape or terminator
+            const uint8_t * z = static_cast<const uint8_t *>(
+                p == buf_end ? 0 : ::memchr(p, flip, buf_end - p));
+            if (z == 0 || buf_end - z < 2)
+                throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                    "bytefluo: attempt to read past end of data");
+            const size_t run = static_cast<size_t>(z - p);
+            const uint8_t marker = uint8_t(z[1] ^ flip);
+            if (marker != 0xFF && marker != 0x01)
+                throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                    "bytefluo: invalid string key");
+            const size_t needed = run + (marker == 0xFF);
+            if (needed > dest_len - len)
+                throw bytefluo_exception(bytefluo_exception::output_buffer_too_small,
+                    "bytefluo: output buffer too small");
+            if (flip)
+                for (size_t i = 0; i < run; ++i)
+                    out[len + i] = uint8_t(~p[i]);
+            else if (run)
+                ::memcpy(out + len, p, run);
+            len += run;
+            p = z + 2;
+            if (marker == 0x01)
+                break;
+            out[len++] = 0;
+        }
+        cursor = p;
+        return len;
+    }
+
+    // start hashing the bytes consumed from the current cursor position on
+    bytefluo & begin_hash()
+    {
+        hash_begin = cursor;
+        hashing = true;
+        return *this;
+    }
+
+    // return the hash64() of the bytes from the cursor position at the last
+    // begin_hash() call up to the current cursor position, and stop hashing
+    uint64_t end_hash(uint64_t seed = 0)
+    {
+        if (!hashing || cursor < hash_begin)
+            throw bytefluo_exception(bytefluo_exception::invalid_hash_range,
+                !hashing
+                    ? "bytefluo: end_hash() without begin_hash()"
+                    : "bytefluo: cursor is before the begin_hash() position");
+        const uint64_t h = hash64(hash_begin, static_cast<size_t>(cursor - hash_begin), seed);
+        hash_begin = 0;
+        hashing = false;
+        return h;
+    }
+
+    // return the XXH64 hash of the 'len' bytes at 'data'; XXH64 is a fast
+    // non-cryptographic hash (see https://github.com/Cyan4973/xxHash)
+    static uint64_t hash64(const void * data, size_t len, uint64_t seed = 0)
+    {
+        const uint64_t p1 = 0x9E3779B185EBCA87ULL;
+        const uint64_t p2 = 0xC2B2AE3D27D4EB4FULL;
+        const uint64_t p3 = 0x165667B19E3779F9ULL;
+        const uint64_t p4 = 0x85EBCA77C2B2AE63ULL;
+        const uint64_t p5 = 0x27D4EB2F165667C5ULL;
+        const uint8_t * p = static_cast<const uint8_t *>(data);
+        const uint8_t * const end = p + len;
+        uint64_t h;
+
+        if (len >= 32) {
+            // four independent lanes, each consuming 8 bytes of every 32
+            uint64_t v[4] = { seed + p1 + p2, seed + p2, seed, seed - p1 };
+            do {
+                for (int i = 0; i < 4; ++i, p += 8)
+                    v[i] = hash64_round(v[i], p);
+            } while (end - p >= 32);
+            h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+            for (int i = 0; i < 4; ++i) {
+                h ^= rotl64(v[i] * p2, 31) * p1;
+                h = h * p1 + p4;
+            }
+        }
+        else
+            h = seed + p5;
+        h += len;
+
+        for (; end - p >= 8; p += 8) {
+            h ^= hash64_round(0, p);
+            h = rotl64(h, 27) * p1 + p4;
+        }
+        if (end - p >= 4) {
+            uint32_t k;
+            impl<uint32_t, 4>::read_le(k, p);
+            h ^= k * p1;
+            h = rotl64(h, 23) * p2 + p3;
+            p += 4;
+        }
+        for (; p != end; ++p) {
+            h ^= *p * p5;
+            h = rotl64(h, 11) * p1;
+        }
+
+        h ^= h >> 33;
+        h *= p2;
+        h ^= h >> 29;
+        h *= p3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    // reversed generator polynomials for crc32(), crc32c() and crc_combine()
+    static const uint32_t crc32_poly  = 0xEDB88320; // CRC-32 (ISO-HDLC, PNG, gzip)
+    static const uint32_t crc32c_poly = 0x82F63B78; // CRC-32C (Castagnoli)
+
+    // return the CRC-32C of the 'len' bytes at the cursor; to continue a CRC
+    // over consecutive ranges pass the CRC of the previous range as 'crc';
+    // if 'advance' is true move the cursor past the bytes
+    uint32_t crc32c(size_t len, uint32_t crc = 0, bool advance = false)
+    {
+        return crc32(len, crc32c_poly, crc, advance);
+    }
+
+    // return the CRC-32 with reversed generator polynomial 'poly' of the 'len'
+    // bytes at the cursor; as for crc32c() otherwise
+    uint32_t crc32(size_t len, uint32_t poly = crc32_poly, uint32_t crc = 0, bool advance = false)
+    {
+        check_elements(len, 1);
+        crc = crc_of(cursor, len, poly, crc);
+        if (advance)
+            cursor += len;
+        return crc;
+    }
+
+    // a bool where the CRC or polynomial belongs, as in crc32c(len, true)
+    // for crc32c(len, 0, true), would silently give the wrong CRC
+    uint32_t crc32c(size_t len, bool advance) = delete;
+    uint32_t crc32c(size_t len, bool advance, uint32_t crc) = delete;
+    uint32_t crc32(size_t len, bool advance) = delete;
+    uint32_t crc32(size_t len, uint32_t poly, bool advance) = delete;
+    uint32_t crc32(size_t len, uint32_t poly, bool advance, uint32_t crc) = delete;
+
+    // return the CRC of the concatenation of two byte ranges, given 'crc1',
+    // the CRC of the first range, and 'crc2' and 'len2', the CRC and length
+    // of the second range, all calculated using reversed polynomial 'poly'
+    static uint32_t crc_combine(uint32_t crc1, uint32_t crc2, uint64_t len2, uint32_t poly)
+    {
+        // the method is from zlib's crc32_combine(): appending len2 zero
+        // bytes to the first range is a linear operation on crc1, computed
+        // by repeatedly squaring the matrix for appending one zero bit
+        if (len2 == 0)
+            return crc1;
+        uint32_t even[32];  // operator for a power-of-two number of zero bits
+        uint32_t odd[32];
+        odd[0] = poly;
+        for (int n = 1; n < 32; ++n)
+            odd[n] = uint32_t(1) << (n - 1);
+        gf2_matrix_square(even, odd);   // 2 zero bits
+        gf2_matrix_square(odd, even);   // 4 zero bits
+        for (;;) {
+            gf2_matrix_square(even, odd);
+            if (len2 & 1)
+                crc1 = gf2_matrix_times(even, crc1);
+            len2 >>= 1;
+            if (len2 == 0)
+                break;
+            gf2_matrix_square(odd, even);
+            if (len2 & 1)
+                crc1 = gf2_matrix_times(odd, crc1);
+            len2 >>= 1;
+            if (len2 == 0)
+                break;
+        }
+        return crc1 ^ crc2;
+    }
+
+    // return the number of bytes, up to 'max_len', before the first byte at
+    // this object's cursor that differs from the byte at the same offset
+    // from 'other's cursor; at most as many bytes as remain in either object
+    // are compared, so the result is that smaller count if no bytes differ;
+    // if 'advance' is true move both cursors past the equal bytes
+    size_t mismatch(bytefluo & other, size_t max_len, bool advance = false)
+    {
+        const size_t len = std::min(max_len, std::min(
+            static_cast<size_t>(buf_end - cursor),
+            static_cast<size_t>(other.buf_end - other.cursor)));
+        const size_t n = mismatch_of(cursor, other.cursor, len);
+        if (advance) {
+            cursor += n;
+            if (&other != this)
+                other.cursor += n;
+        }
+        return n;
+    }
+
+    // compare the 'len' bytes at this object's cursor with the 'len' bytes
+    // at 'other's cursor; return a value less than, equal to or greater than
+    // zero as for memcmp(); if 'advance' is true move both cursors past the
+    // compared bytes
+    int compare(bytefluo & other, size_t len, bool advance = false)
+    {
+        check_elements(len, 1);
+        other.check_elements(len, 1);
+        const int result = len ? ::memcmp(cursor, other.cursor, len) : 0;
+        if (advance) {
+            cursor += len;
+            if (&other != this)
+                other.cursor += len;
+        }
+        return result;
+    }
+
+    // return the Internet checksum (RFC 1071) of the 'len' bytes at the cursor:
+    // the one's complement of the one's complement sum of the big-endian
+    // 16-bit words, with an odd final byte padded with a zero byte; 'seed'
+    // is added to the sum, e.g. the sum of a TCP or UDP pseudo-header's
+    // words; if 'advance' is true move the cursor past the bytes
+    uint16_t inet_checksum(size_t len, uint32_t seed = 0, bool advance = false)
+    {
+        check_elements(len, 1);
+        const uint16_t checksum = inet_checksum_of(cursor, len, seed);
+        if (advance)
+            cursor += len;
+        return checksum;
+    }
+
+    // for each i in [0, n), set out[i] to the inet_checksum() of the
+    // ranges[i].second bytes at ranges[i].first bytes from the buffer
+    // beginning, with seeds[i] as its seed, or 0 if 'seeds' is 0; every range
+    // is checked before any checksum is calculated; the cursor is not moved
+    void inet_checksum_batch(const std::pair<size_t, size_t> * ranges, size_t n,
+        uint16_t * out, const uint32_t * seeds = 0) const
+    {
+        const size_t siz = static_cast<size_t>(buf_end - buf_begin);
+        for (size_t i = 0; i < n; ++i) {
+            if (ranges[i].first > siz || ranges[i].second > siz - ranges[i].first)
+                throw bytefluo_exception(bytefluo_exception::attempt_to_read_past_end,
+                    "bytefluo: attempt to read past end of data");
+        }
+        for (size_t i = 0; i < n; ++i)
+            out[i] = inet_checksum_of(buf_begin + ranges[i].first, ranges[i].second,
+                seeds ? seeds[i] : 0);
+    }
+
+    // move cursor 'pos' bytes from stream beginning
+    size_t seek_begin(size_t pos)
+    {
+        if (pos > static_cast<size_t>(buf_end - buf_begin))
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        cursor = buf_begin + pos;
+        return static_cast<size_t>(cursor - buf_begin);
+    }
+
+    // move cursor 'pos' bytes from current position
+    size_t seek_current(long pos)
+    {
+        if (pos < 0) { // seek backward
+            if (pos < static_cast<long>(buf_begin - cursor))
+                throw bytefluo_exception(
+                    bytefluo_exception::attempt_to_seek_before_beginning,
+                    "bytefluo: attempt to seek before beginning of data");
+        }
+        else { // seek forward (or nowhere)
+            if (pos > static_cast<long>(buf_end - cursor))
+                throw bytefluo_exception(
+                    bytefluo_exception::attempt_to_seek_after_end,
+                    "bytefluo: attempt to seek after end of data");
+        }
+        cursor += pos;
+        return static_cast<size_t>(cursor - buf_begin);
+    }
+
+    // move cursor 'pos' bytes from stream end
+    size_t seek_end(size_t pos)
+    {
+        if (pos > static_cast<size_t>(buf_end - buf_begin))
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_before_beginning,
+                "bytefluo: attempt to seek before beginning of data");
+        cursor = buf_end - pos;
+        return static_cast<size_t>(cursor - buf_begin);
+    }
+
+    // move cursor to the first position at or after the cursor where 'marker'
+    // is found 'confirmations' times in succession, 'period' bytes apart;
+    // return false and leave the cursor unchanged if there is no such position
+    bool resync(uint8_t marker, size_t period, size_t confirmations)
+    {
+        if (period == 0 || confirmations == 0)
+            throw bytefluo_exception(bytefluo_exception::invalid_argument,
+                "bytefluo: resync period and confirmations must be non-zero");
+        const size_t len = static_cast<size_t>(buf_end - cursor);
+        if (confirmations - 1 >= (len == 0 ? 0 : (len - 1) / period + 1))
+            return false;
+
+        // candidates are where the first marker leaves room for the rest
+        const uint8_t * const last = buf_end - (confirmations - 1) * period;
+        const uint8_t * p = cursor;
+        while (p < last) {
+            // memchr() is typically vectorised, so skipping through the
+            // corrupt bytes to the next candidate is fast
+            p = static_cast<const uint8_t *>(::memchr(p, marker, last - p));
+            if (p == 0)
+                break;
+            size_t k = 1;
+            while (k < confirmations && p[k * period] == marker)
+                ++k;
+            if (k == confirmations) {
+                cursor = p;
+                return true;
+            }
+            ++p;
+        }
+        return false;
+    }
+
+    // return true iff cursor is at end of stream
+    bool eos() const
+    {
+        return cursor == buf_end;
+    }
+
+    // return number of bytes in stream
+    size_t size() const
+    {
+        return static_cast<size_t>(buf_end - buf_begin);
+    }
+
+    // return distance from buffer start to cursor
+    size_t tellg() const
+    {
+        return static_cast<size_t>(cursor - buf_begin);
+    }
+    
+private:
+    const uint8_t * buf_begin;
+    const uint8_t * buf_end;
+    const uint8_t * cursor;
+    byte_order buf_byte_order;
+    const uint8_t * hash_begin; // where begin_hash() was called
+    bool hashing;               // true between begin_hash() and end_hash()
+
+    // throw an exception if given buffer limits are obviously bad
+    static void validate(const void * begin, const void * end)
+    {
+        if (begin == 0 && end != 0)
+            throw bytefluo_exception(
+                bytefluo_exception::null_begin_non_null_end,
+                "bytefluo: begin is 0, end isn't");
+        if (begin != 0 && end == 0)
+            throw bytefluo_exception(
+                bytefluo_exception::null_end_non_null_begin,
+                "bytefluo: end is 0, begin isn't");
+        if (end < begin)
+            throw bytefluo_exception(
+                bytefluo_exception::end_precedes_begin,
+                "bytefluo: end precedes begin");
+    }
+};
 
 
 // return bytefluo object to manage access to bytes in given 'vec';
@@ -369,4 +1730,745 @@ bytefluo bytefluo_from_vector(
 }
 
 
+// an immutable sequence of bytes that owns them: copies and slices of a
+// bytefluo_buffer share the bytes, which are freed when the last copy,
+// slice or bytefluo_shared reading them is destroyed; the count of
+// owners is atomic, so they may be passed between threads freely
+class bytefluo_buffer {
+public:
+    // an empty buffer
+    bytefluo_buffer()
+    : begin(0), len(0)
+    {
+    }
+
+    // a buffer holding a copy of the 'size' bytes at 'data'
+    bytefluo_buffer(const void * data, size_t size)
+    : begin(0), len(size)
+    {
+        if (data == 0 && size != 0)
+            throw bytefluo_exception(
+                bytefluo_exception::null_begin_non_null_end,
+                "bytefluo: begin is 0, end isn't");
+        if (size) {
+            uint8_t * const p = new uint8_t[size];
+            owner.reset(p, std::default_delete<uint8_t[]>());
+            ::memcpy(p, data, size);
+            begin = p;
+        }
+    }
+
+    // a buffer holding the bytes of 'vec', which is left empty; the bytes
+    // are not copied
+    explicit bytefluo_buffer(std::vector<uint8_t> && vec)
+    : begin(0), len(vec.size())
+    {
+        if (len) {
+            std::shared_ptr<std::vector<uint8_t> > v(
+                std::make_shared<std::vector<uint8_t> >(std::move(vec)));
+            begin = &(*v)[0];
+            owner = v;
+        }
+    }
+
+    // a buffer holding the 'size' bytes at 'data', which 'deleter' will
+    // free by being called with 'data' when no longer needed; e.g.
+    //   bytefluo_buffer(p, n, [n](const void * p) { ::munmap(const_cast<void *>(p), n); })
+    // if the constructor throws, 'deleter' is called before it does
+    template <typename deleter_type>
+    bytefluo_buffer(const void * data, size_t size, deleter_type deleter)
+    : owner(data, deleter), begin(static_cast<const uint8_t *>(data)), len(size)
+    {
+        if (data == 0 && size != 0)
+            throw bytefluo_exception(
+                bytefluo_exception::null_begin_non_null_end,
+                "bytefluo: begin is 0, end isn't");
+    }
+
+    const uint8_t * data() const
+    {
+        return begin;
+    }
+
+    size_t size() const
+    {
+        return len;
+    }
+
+    bool empty() const
+    {
+        return len == 0;
+    }
+
+    // return a buffer sharing the 'size' bytes at offset 'pos' in this
+    // buffer, in constant time; throws if they aren't all in this buffer
+    bytefluo_buffer slice(size_t pos, size_t size) const
+    {
+        if (pos > len)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        if (size > len - pos)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+        bytefluo_buffer result(*this);
+        result.begin = size ? begin + pos : 0;
+        result.len = size;
+        return result;
+    }
+
+    // return the number of buffers, including this one, sharing the bytes
+    long use_count() const
+    {
+        return owner.use_count();
+    }
+
+private:
+    std::shared_ptr<const void> owner;  // frees the bytes when the last owner goes
+    const uint8_t * begin;
+    size_t len;
+};
+
+
+// a bytefluo that manages access to the bytes of a bytefluo_buffer and
+// keeps them alive for as long as it, or a copy of it, exists; unlike
+// bytefluo_from_vector(), nothing done to other owners of the bytes can
+// invalidate it; bytefluo has no virtual destructor, so a bytefluo_shared
+// must not be deleted through a bytefluo pointer, and a bytefluo copied
+// from it doesn't keep the bytes alive
+class bytefluo_shared : public bytefluo {
+public:
+    // manage access to the bytes of 'buffer', with scalar reads assuming
+    // byte order 'bo'
+    bytefluo_shared(const bytefluo_buffer & buffer, byte_order bo)
+    : bytefluo(buffer.data(), buffer.data() + buffer.size(), bo), buf(buffer)
+    {
+    }
+
+    // return the bytes being read
+    const bytefluo_buffer & buffer() const
+    {
+        return buf;
+    }
+
+private:
+    bytefluo_buffer buf;
+
+    // the managed range is always the whole buffer
+    using bytefluo::set_data_range;
+};
+
+
+
+// random-access views of arrays of big-endian and little-endian scalars
+template <typename scalar_type>
+using be_array_view = bytefluo::array_view<scalar_type, bytefluo::big>;
+template <typename scalar_type>
+using le_array_view = bytefluo::array_view<scalar_type, bytefluo::little>;
+
+
+// a bytefluo_source supplies the bytes read via a bytefluo_stream; unlike
+// the buffer managed by a bytefluo object the bytes need not all be in
+// memory at once, nor need their total number be known in advance
+class bytefluo_source {
+public:
+    // size() result for a source that can't tell how many bytes it holds
+    static const uint64_t unknown_size = UINT64_MAX;
+
+    virtual ~bytefluo_source()
+    {
+    }
+
+    // return the total number of bytes in the source, or unknown_size
+    virtual uint64_t size() = 0;
+
+    // make the bytes at stream offset 'pos' available in memory; set 'data'
+    // to point at the byte at 'pos' and return the number of contiguous
+    // bytes available there, which will be at least 'min_len' unless the
+    // end of the data comes first, and 0 iff 'pos' is the end of the data;
+    // 'data' remains valid until the next call to fetch(); throws
+    // bytefluo_exception if 'pos' is beyond the end of the data, or if
+    // the source can't return to 'pos'
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data) = 0;
+};
+
+
+// manage specific byte-order read-only access to the bytes supplied by a
+// bytefluo_source; reads lying entirely within the block of bytes most
+// recently fetched from the source cost no more than the equivalent
+// bytefluo reads; other reads fetch a new block
+class bytefluo_stream {
+public:
+    typedef bytefluo::byte_order byte_order;
+
+    // bytefluo_stream will manage access to the bytes supplied by 'src'
+    // and scalar reads will assume given byte order 'bo'; 'src' must
+    // outlive this bytefluo_stream
+    bytefluo_stream(bytefluo_source & src, byte_order bo)
+    : src(&src), win_begin(0), win_end(0), cursor(0), win_pos(0),
+      buf_byte_order(bo)
+    {
+        if (buf_byte_order != bytefluo::big && buf_byte_order != bytefluo::little)
+            throw bytefluo_exception(bytefluo_exception::invalid_byte_order,
+                "bytefluo: invalid byte order");
+    }
+
+    // specify the byte order to be used on subsequent scalar reads
+    bytefluo_stream & set_byte_order(byte_order bo)
+    {
+        if (bo != bytefluo::big && bo != bytefluo::little)
+            throw bytefluo_exception(bytefluo_exception::invalid_byte_order,
+                "bytefluo: invalid byte order");
+        buf_byte_order = bo;
+        return *this;
+    }
+
+    // read an integer scalar value from stream at current cursor position;
+    // use big-endian byte order (ignore buf_byte_order value and save time)
+    template <typename scalar_type>
+    bytefluo_stream & read_be(scalar_type & out)
+    {
+        if (win_end - cursor < static_cast<ptrdiff_t>(sizeof(scalar_type)))
+            fill(sizeof(scalar_type));
+        bytefluo::impl<scalar_type, sizeof(scalar_type)>::read_be(out, cursor);
+        cursor += sizeof(scalar_type);
+        return *this;
+    }
+
+    // read an integer scalar value from stream at current cursor position;
+    // use little-endian byte order (ignore buf_byte_order value and save time)
+    template <typename scalar_type>
+    bytefluo_stream & read_le(scalar_type & out)
+    {
+        if (win_end - cursor < static_cast<ptrdiff_t>(sizeof(scalar_type)))
+            fill(sizeof(scalar_type));
+        bytefluo::impl<scalar_type, sizeof(scalar_type)>::read_le(out, cursor);
+        cursor += sizeof(scalar_type);
+        return *this;
+    }
+
+    // read an integer scalar value from stream at current cursor position;
+    // byte order determined by current buf_byte_order value
+    template <typename scalar_type>
+    bytefluo_stream & operator>>(scalar_type & out)
+    {
+        if (win_end - cursor < static_cast<ptrdiff_t>(sizeof(scalar_type)))
+            fill(sizeof(scalar_type));
+        if (buf_byte_order == bytefluo::little)
+            bytefluo::impl<scalar_type, sizeof(scalar_type)>::read_le(out, cursor);
+        else
+            bytefluo::impl<scalar_type, sizeof(scalar_type)>::read_be(out, cursor);
+        cursor += sizeof(scalar_type);
+        return *this;
+    }
+
+    // copy 'len' bytes from stream at current cursor position to given 'dest'
+    // note that current buf_byte_order has no affect on this operation
+    bytefluo_stream & read(void * dest, size_t len)
+    {
+        if (win_end - cursor >= static_cast<ptrdiff_t>(len)) {
+            ::memcpy(dest, cursor, len);
+            cursor += len;
+            return *this;
+        }
+
+        const uint64_t start = tellg();
+        const uint64_t siz = src->size();
+        if (siz != bytefluo_source::unknown_size && len > siz - start)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+
+        // copy the bytes a block at a time so that the source need not
+        // hold all 'len' bytes in memory at once; if the data ends first
+        // the cursor goes back to 'start' without fetching it again, as a
+        // source that can't seek backwards may have discarded the bytes
+        // there; the next read will fetch them if the source still can
+        uint8_t * out = static_cast<uint8_t *>(dest);
+        while (len) {
+            if (cursor == win_end && fetch(tellg(), 1) == 0) {
+                win_begin = win_end = cursor = 0;
+                win_pos = start;
+                throw bytefluo_exception(
+                    bytefluo_exception::attempt_to_read_past_end,
+                    "bytefluo: attempt to read past end of data");
+            }
+            size_t n = static_cast<size_t>(win_end - cursor);
+            if (n > len)
+                n = len;
+            ::memcpy(out, cursor, n);
+            cursor += n;
+            out += n;
+            len -= n;
+        }
+        return *this;
+    }
+
+    // move cursor 'pos' bytes from stream beginning
+    uint64_t seek_begin(uint64_t pos)
+    {
+        const uint64_t siz = src->size();
+        if (siz != bytefluo_source::unknown_size && pos > siz)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        move_to(pos);
+        return tellg();
+    }
+
+    // move cursor 'pos' bytes from current position
+    uint64_t seek_current(long pos)
+    {
+        const uint64_t current = tellg();
+        if (pos < 0 && static_cast<uint64_t>(-(pos + 1)) + 1 > current)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_before_beginning,
+                "bytefluo: attempt to seek before beginning of data");
+        return seek_begin(current + pos);
+    }
+
+    // move cursor 'pos' bytes from stream end
+    uint64_t seek_end(uint64_t pos)
+    {
+        const uint64_t siz = src->size();
+        if (siz == bytefluo_source::unknown_size)
+            throw bytefluo_exception(
+                bytefluo_exception::seek_not_supported,
+                "bytefluo: stream end is unknown");
+        if (pos > siz)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_before_beginning,
+                "bytefluo: attempt to seek before beginning of data");
+        move_to(siz - pos);
+        return tellg();
+    }
+
+    // return true iff cursor is at end of stream
+    bool eos()
+    {
+        if (cursor != win_end)
+            return false;
+        const uint64_t siz = src->size();
+        if (siz != bytefluo_source::unknown_size)
+            return tellg() == siz;
+        return fetch(tellg(), 1) == 0;
+    }
+
+    // return number of bytes in stream, or bytefluo_source::unknown_size
+    uint64_t size() const
+    {
+        return src->size();
+    }
+
+    // return distance from stream start to cursor
+    uint64_t tellg() const
+    {
+        return win_pos + static_cast<uint64_t>(cursor - win_begin);
+    }
+
+private:
+    bytefluo_source * src;
+    const uint8_t * win_begin;  // the block of bytes most recently fetched
+    const uint8_t * win_end;
+    const uint8_t * cursor;     // win_begin <= cursor <= win_end
+    uint64_t win_pos;           // stream offset of byte at win_begin
+    byte_order buf_byte_order;
+
+    // fetch the block at stream offset 'pos'; return the number of bytes in it
+    size_t fetch(uint64_t pos, size_t min_len)
+    {
+        const uint8_t * data = 0;
+        size_t len = 0;
+        try {
+            len = src->fetch(pos, min_len, data);
+        }
+        catch (...) {
+            // the old block may no longer be valid; the next read will refetch
+            // it, and the cursor position is unchanged
+            win_pos = tellg();
+            win_begin = win_end = cursor = 0;
+            throw;
+        }
+        win_begin = cursor = data;
+        win_end = data + len;
+        win_pos = pos;
+        return len;
+    }
+
+    // make at least 'len' contiguous bytes available at the cursor
+    void fill(size_t len)
+    {
+        if (fetch(tellg(), len) < len)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_read_past_end,
+                "bytefluo: attempt to read past end of data");
+    }
+
+    // move cursor to stream offset 'pos'
+    void move_to(uint64_t pos)
+    {
+        if (pos >= win_pos && pos - win_pos <= static_cast<uint64_t>(win_end - win_begin))
+            cursor = win_begin + (pos - win_pos);
+        else if (src->size() != bytefluo_source::unknown_size) {
+            // fetch lazily; the next read will fetch the block at 'pos'
+            win_begin = win_end = cursor = 0;
+            win_pos = pos;
+        }
+        else
+            fetch(pos, 0); // the source will throw if 'pos' is after the end
+    }
+};
+
+
+// a bytefluo_source that decodes hex or base64 text held in memory, one
+// block at a time, so that the decoded bytes need never be held in full
+class bytefluo_decoding_source : public bytefluo_source {
+public:
+    enum encoding {
+        hex,        // two hex digits per byte, upper or lower case
+        base64,     // RFC 4648 base64 alphabet, padding optional
+        base64url   // RFC 4648 URL and filename safe alphabet, padding optional
+    };
+
+    // bytes will be decoded from the text in [begin, end) in blocks of
+    // (about) 'block_size' bytes
+    bytefluo_decoding_source(
+        const void * begin,
+        const void * end,
+        encoding enc,
+        size_t block_size = 4096)
+    : text(static_cast<const uint8_t *>(begin)), text_len(0), enc(enc),
+      block_size(block_size ? block_size : 1), decoded_size(0),
+      blk_pos(0), blk_len(0)
+    {
+        bytefluo::validate(begin, end);
+        text_len = static_cast<size_t>(static_cast<const uint8_t *>(end) - text);
+
+        ::memset(table, 0x80, sizeof(table)); // 0x80 marks an invalid character
+        if (enc == hex) {
+            for (int i = 0; i < 10; ++i)
+                table['0' + i] = uint8_t(i);
+            for (int i = 0; i < 6; ++i)
+                table['a' + i] = table['A' + i] = uint8_t(10 + i);
+            if (text_len % 2)
+                throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                    "bytefluo: odd hex text length");
+            decoded_size = text_len / 2;
+        }
+        else if (enc == base64 || enc == base64url) {
+            for (int i = 0; i < 26; ++i) {
+                table['A' + i] = uint8_t(i);
+                table['a' + i] = uint8_t(26 + i);
+            }
+            for (int i = 0; i < 10; ++i)
+                table['0' + i] = uint8_t(52 + i);
+            table[uint8_t(enc == base64 ? '+' : '-')] = 62;
+            table[uint8_t(enc == base64 ? '/' : '_')] = 63;
+
+            // padding is ignored, but if present it must complete the last group
+            if (text_len % 4 == 0) {
+                for (int i = 0; i < 2 && text_len && text[text_len - 1] == '='; ++i)
+                    --text_len;
+            }
+            if (text_len % 4 == 1)
+                throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                    "bytefluo: invalid base64 text length");
+            decoded_size = text_len / 4 * 3 + (text_len % 4 ? text_len % 4 - 1 : 0);
+        }
+        else
+            throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                "bytefluo: invalid encoding");
+    }
+
+    virtual uint64_t size()
+    {
+        return decoded_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        if (pos > decoded_size)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        const size_t p = static_cast<size_t>(pos);
+        const size_t remaining = decoded_size - p;
+        const size_t wanted = min_len < remaining ? min_len : remaining;
+        if (p < blk_pos || p + wanted > blk_pos + blk_len) {
+            blk_len = 0;
+            if (enc == hex)
+                decode_hex(p, wanted);
+            else
+                decode_base64(p, wanted);
+        }
+        data = blk.empty() ? 0 : &blk[0] + (p - blk_pos);
+        return blk_pos + blk_len - p;
+    }
+
+private:
+    const uint8_t * text;
+    size_t text_len;            // excluding any base64 padding
+    encoding enc;
+    size_t block_size;
+    size_t decoded_size;
+    uint8_t table[256];         // character -> digit value, 0x80 if invalid
+    std::vector<uint8_t> blk;   // decoded bytes [blk_pos, blk_pos + blk_len)
+    size_t blk_pos;
+    size_t blk_len;
+
+    void decode_hex(size_t pos, size_t wanted)
+    {
+        const size_t len = wanted > block_size ? wanted : block_size;
+        const size_t stop = len < decoded_size - pos ? pos + len : decoded_size;
+        blk.resize(stop - pos + 1);
+        const uint8_t * in = text + pos * 2;
+        uint8_t * out = &blk[0];
+        unsigned bad = 0;
+        for (size_t i = pos; i < stop; ++i, in += 2) {
+            const unsigned h = table[in[0]];
+            const unsigned l = table[in[1]];
+            bad |= h | l;
+            *out++ = uint8_t(h << 4 | l);
+        }
+        if (bad & 0x80)
+            throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                "bytefluo: invalid hex digit");
+        blk_pos = pos;
+        blk_len = stop - pos;
+    }
+
+    void decode_base64(size_t pos, size_t wanted)
+    {
+        // blocks begin on a 3-byte (4-character) group boundary
+        const size_t start = pos - pos % 3;
+        size_t len = pos - start + wanted;
+        if (len < block_size)
+            len = block_size;
+        len += (3 - len % 3) % 3;
+        const size_t stop = len < decoded_size - start ? start + len : decoded_size;
+        blk.resize(stop - start + 3);
+        const uint8_t * in = text + start / 3 * 4;
+        uint8_t * out = &blk[0];
+        unsigned bad = 0;
+
+        // whole groups: four characters make three bytes
+        size_t groups = (stop - start) / 3;
+        for (; groups; --groups, in += 4, out += 3) {
+            const unsigned a = table[in[0]];
+            const unsigned b = table[in[1]];
+            const unsigned c = table[in[2]];
+            const unsigned d = table[in[3]];
+            bad |= a | b | c | d;
+            const uint32_t v = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6 | d;
+            out[0] = uint8_t(v >> 16);
+            out[1] = uint8_t(v >> 8);
+            out[2] = uint8_t(v);
+        }
+
+        // the unpadded final group: two or three characters make one or two bytes
+        const size_t tail = (stop - start) % 3;
+        if (tail) {
+            const unsigned a = table[in[0]];
+            const unsigned b = table[in[1]];
+            const unsigned c = tail == 2 ? table[in[2]] : 0;
+            bad |= a | b | c;
+            const uint32_t v = uint32_t(a) << 18 | uint32_t(b) << 12 | uint32_t(c) << 6;
+            out[0] = uint8_t(v >> 16);
+            if (tail == 2)
+                out[1] = uint8_t(v >> 8);
+        }
+
+        if (bad & 0x80)
+            throw bytefluo_exception(bytefluo_exception::invalid_encoding,
+                "bytefluo: invalid base64 character");
+        blk_pos = start;
+        blk_len = stop - start;
+    }
+};
+
+
+// a bytefluo_source that supplies the bytes in a sequence of separate
+// memory segments, such as the iovec array of a scattered packet, as one
+// stream; the segments are not copied and must outlive the source
+class bytefluo_segmented_source : public bytefluo_source {
+public:
+    // a segment is the 'second' bytes at 'first'
+    typedef std::pair<const void *, size_t> segment;
+
+    // the stream will be the bytes of the 'n' segments at 'segments' in turn
+    bytefluo_segmented_source(const segment * segments, size_t n)
+    : starts(1, 0), current(0)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            if (segments[i].first == 0 && segments[i].second != 0)
+                throw bytefluo_exception(bytefluo_exception::null_begin_non_null_end,
+                    "bytefluo: segment is 0, its length isn't");
+            if (segments[i].second == 0)
+                continue; // empty segments needn't be searched
+            data.push_back(static_cast<const uint8_t *>(segments[i].first));
+            starts.push_back(starts.back() + segments[i].second);
+        }
+    }
+
+    virtual uint64_t size()
+    {
+        return starts.back();
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& out)
+    {
+        if (pos > starts.back())
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        if (pos == starts.back()) {
+            out = 0;
+            return 0;
+        }
+
+        // find the segment holding 'pos': usually the current or next one,
+        // otherwise binary search the segment start offsets
+        if (!(starts[current] <= pos && pos < starts[current + 1])) {
+            if (current + 2 < starts.size() && starts[current + 1] <= pos && pos < starts[current + 2])
+                ++current;
+            else
+                current = static_cast<size_t>(
+                    std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin()) - 1;
+        }
+
+        // the fast path: the bytes are contiguous in one segment
+        const size_t offset = static_cast<size_t>(pos - starts[current]);
+        const size_t avail = static_cast<size_t>(starts[current + 1] - pos);
+        const size_t wanted = min_len < starts.back() - pos
+            ? min_len : static_cast<size_t>(starts.back() - pos);
+        if (avail >= wanted) {
+            out = data[current] + offset;
+            return avail;
+        }
+
+        // the bytes wanted straddle segments; copy them to the scratch buffer
+        scratch.assign(data[current] + offset, data[current] + offset + avail);
+        for (size_t i = current + 1; scratch.size() < wanted; ++i) {
+            const size_t n = std::min(wanted - scratch.size(),
+                static_cast<size_t>(starts[i + 1] - starts[i]));
+            scratch.insert(scratch.end(), data[i], data[i] + n);
+        }
+        out = &scratch[0];
+        return scratch.size();
+    }
+
+private:
+    std::vector<const uint8_t *> data;  // the non-empty segments
+    std::vector<uint64_t> starts;       // starts[i] is the stream offset of data[i];
+                                        // starts.back() is the total size
+    size_t current;                     // the segment most recently fetched from
+    std::vector<uint8_t> scratch;
+};
+
+
+// a bytefluo_source that reads its bytes, in order, from a function such
+// as a wrapper around read(2); the bytes are held in a buffer of about
+// 'chunk_size' bytes, so the memory used doesn't depend on the data size
+class bytefluo_reader_source : public bytefluo_source {
+public:
+    // a read_function copies up to 'len' bytes of the data to 'dest' and
+    // returns the number copied, which is 0 iff there are no more
+    typedef std::function<size_t (void * dest, size_t len)> read_function;
+
+    // bytes will be read from 'read' in chunks of up to 'chunk_size' bytes
+    explicit bytefluo_reader_source(read_function read, size_t chunk_size = 65536)
+    : read(read), buf(chunk_size ? chunk_size : 1), buf_pos(0), buf_len(0),
+      last_pos(0), at_end(false)
+    {
+    }
+
+    virtual uint64_t size()
+    {
+        return unknown_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        // the data can only be read once, so bytes before the buffer are gone
+        if (pos < buf_pos)
+            throw bytefluo_exception(
+                bytefluo_exception::seek_not_supported,
+                "bytefluo: source can't seek backwards");
+
+        // read ahead until 'pos' is in the buffer, keeping the bytes from
+        // the last position fetched, so that if 'pos' is after the end the
+        // stream can go on reading where it was; then drop the bytes before
+        // 'pos' and give back the memory grown meanwhile
+        if (pos > buf_pos + buf_len) {
+            const size_t old_size = buf.size();
+            const uint64_t keep_pos = std::max(last_pos, buf_pos);
+            const size_t keep_from = static_cast<size_t>(keep_pos - buf_pos);
+            ::memmove(&buf[0], &buf[0] + keep_from, buf_len - keep_from);
+            buf_len -= keep_from;
+            buf_pos = keep_pos;
+            while (pos > buf_pos + buf_len) {
+                if (buf_len == buf.size()) {
+                    const uint64_t needed = pos - buf_pos;
+                    buf.resize(static_cast<size_t>(std::min<uint64_t>(needed, 2 * buf.size())));
+                }
+                if (refill() == 0)
+                    throw bytefluo_exception(
+                        bytefluo_exception::attempt_to_seek_after_end,
+                        "bytefluo: attempt to seek after end of data");
+            }
+            const size_t skip = static_cast<size_t>(pos - buf_pos);
+            ::memmove(&buf[0], &buf[0] + skip, buf_len - skip);
+            buf_len -= skip;
+            buf_pos = pos;
+            if (buf.size() > old_size) {
+                buf.resize(std::max(old_size, buf_len));
+                buf.shrink_to_fit();
+            }
+        }
+
+        // if too few bytes follow 'pos', move them to the front of the
+        // buffer and read more after them
+        size_t offset = static_cast<size_t>(pos - buf_pos);
+        const size_t wanted = min_len ? min_len : 1;
+        if (buf_len - offset < wanted && !at_end) {
+            ::memmove(&buf[0], &buf[0] + offset, buf_len - offset);
+            buf_len -= offset;
+            buf_pos = pos;
+            offset = 0;
+            if (buf.size() < wanted)
+                buf.resize(wanted);
+            while (buf_len < wanted && refill())
+                ;
+        }
+        last_pos = pos;
+        data = &buf[0] + offset;
+        return buf_len - offset;
+    }
+
+private:
+    read_function read;
+    std::vector<uint8_t> buf;   // bytes [buf_pos, buf_pos + buf_len) of the data
+    uint64_t buf_pos;
+    size_t buf_len;
+    uint64_t last_pos;          // the 'pos' of the last successful fetch()
+    bool at_end;                // true once 'read' has returned 0
+
+    // read bytes into the free space at the end of the buffer; return the
+    // number read
+    size_t refill()
+    {
+        if (at_end || buf_len == buf.size())
+            return 0;
+        const size_t n = read(&buf[0] + buf_len, buf.size() - buf_len);
+        if (n > buf.size() - buf_len)
+            throw bytefluo_exception(bytefluo_exception::invalid_argument,
+                "bytefluo: read function returned too many bytes");
+        at_end = n == 0;
+        buf_len += n;
+        return n;
+    }
+};
+
+
 #endif //#ifdef BYTEFLUO_H_INCLUDED
@@ -0,0 +1,1331 @@
+#ifndef BYTEFLUO_POSIX_H_INCLUDED
+#define BYTEFLUO_POSIX_H_INCLUDED
+
+/*  bytefluo is distributed under the MIT License:
+
+        MIT License
+
+        Copyright (c) 2008,2009,2010,2016,2017 Anthony C. Hay
+
+        Permission is hereby granted, free of charge, to any person obtaining a copy
+        of this software and associated documentation files (the "Software"), to deal
+        in the Software without restriction, including without limitation the rights
+        to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+        copies of the Software, and to permit persons to whom the Software is
+        furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be included in all
+        copies or substantial portions of the Software.
+
+        THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+        IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+        FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+        LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+        OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+        SOFTWARE.
+
+    Purpose:
+    bytefluo classes that read data via POSIX file and memory-mapping
+    system calls. This header is not needed, and won't compile, on
+    systems without these calls, such as Windows. */
+
+#include "bytefluo.h"
+#include "bytefluo_thread.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <future>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// BYTEFLUO_HAS_IO_URING is defined iff the io_uring system calls can be compiled
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#include <sys/uio.h>
+#define BYTEFLUO_HAS_IO_URING
+#endif
+#endif
+#endif
+
+
+// throw a bytefluo_exception with id io_error and a message made from
+// 'what' and the current errno value
+inline void bytefluo_throw_io_error(const char * what)
+{
+    const int err = errno;
+    throw bytefluo_exception(bytefluo_exception::io_error,
+        (std::string("bytefluo: ") + what + ": " + ::strerror(err)).c_str());
+}
+
+
+// a bytefluo object managing access to the whole of a file, which is
+// mapped read-only into memory for the lifetime of the bytefluo_file;
+// no bytes are copied, and only the pages actually read are loaded;
+// bytefluo has no virtual destructor, so a bytefluo_file must not be
+// deleted through a bytefluo pointer, and a bytefluo copied from it
+// doesn't own the mapping
+class bytefluo_file : public bytefluo {
+public:
+    // access pattern hints for advise()
+    enum access_hint {
+        normal,     // no special treatment
+        sequential, // read ahead aggressively; pages may be freed soon after use
+        random,     // don't read ahead
+        willneed,   // start loading the whole file now
+        hugepage    // back the mapping with huge pages if the system can
+    };
+
+    // map the file at 'path' and manage access to all its bytes, with
+    // scalar reads assuming byte order 'bo'; if 'populate' is true load
+    // the whole file before returning, where the system supports this
+    bytefluo_file(const char * path, byte_order bo, bool populate = false)
+    : bytefluo(0, 0, bo), map(0), map_len(0)
+    {
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            bytefluo_throw_io_error("can't open file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't get file size");
+        }
+        if (static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+            ::close(fd);
+            errno = EFBIG;
+            bytefluo_throw_io_error("can't map file");
+        }
+        map_len = static_cast<size_t>(st.st_size);
+
+        // an empty file can't be mapped; it is managed as an empty range
+        if (map_len) {
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            if (populate)
+                flags |= MAP_POPULATE;
+#endif
+            void * p = ::mmap(0, map_len, PROT_READ, flags, fd, 0);
+            if (p == MAP_FAILED) {
+                const int err = errno;
+                ::close(fd);
+                errno = err;
+                bytefluo_throw_io_error("can't map file");
+            }
+            map = p;
+#ifndef MAP_POPULATE
+            if (populate)
+                advise(willneed);
+#endif
+        }
+        ::close(fd); // the mapping keeps the file open
+        bytefluo::set_data_range(map, static_cast<const uint8_t *>(map) + map_len);
+    }
+
+    // take over the mapping of 'other', which is left managing an empty range
+    bytefluo_file(bytefluo_file && other)
+    : bytefluo(other), map(other.map), map_len(other.map_len)
+    {
+        other.map = 0;
+        other.map_len = 0;
+        other.bytefluo::set_data_range(0, 0);
+    }
+
+    ~bytefluo_file()
+    {
+        if (map)
+            ::munmap(map, map_len);
+    }
+
+    // tell the system how the file will be read; return false if the
+    // hint isn't supported here; the hint affects performance only
+    bool advise(access_hint hint)
+    {
+        if (map == 0)
+            return true;
+        int advice;
+        switch (hint) {
+        case normal:        advice = MADV_NORMAL; break;
+        case sequential:    advice = MADV_SEQUENTIAL; break;
+        case random:        advice = MADV_RANDOM; break;
+        case willneed:      advice = MADV_WILLNEED; break;
+#ifdef MADV_HUGEPAGE
+        case hugepage:      advice = MADV_HUGEPAGE; break;
+#endif
+        default:            return false;
+        }
+        return ::madvise(map, map_len, advice) == 0;
+    }
+
+    // start loading the 'len' bytes at the cursor, or as many of them as
+    // lie before the end of the file, so that reading them later won't
+    // block; the cursor is not moved
+    void prefetch(size_t len)
+    {
+        const uint8_t * const begin = static_cast<const uint8_t *>(map);
+        const size_t pos = static_cast<size_t>(tellg());
+        if (len > map_len - pos)
+            len = map_len - pos;
+        if (len == 0)
+            return;
+        // madvise() requires a page-aligned address
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t start = pos - pos % page;
+        ::madvise(const_cast<uint8_t *>(begin) + start, pos - start + len, MADV_WILLNEED);
+    }
+
+private:
+    void * map;         // the mapping, or 0 if the file is empty
+    size_t map_len;
+
+    // the managed range is always the whole mapping
+    using bytefluo::set_data_range;
+
+    bytefluo_file(const bytefluo_file &) = delete;
+    bytefluo_file & operator=(const bytefluo_file &) = delete;
+};
+
+
+// return a bytefluo_buffer holding the bytes of the file at 'path',
+// mapped read-only; the mapping is removed when the last owner of the
+// bytes is destroyed; if 'populate' is true load the whole file before
+// returning, where the system supports this
+inline bytefluo_buffer bytefluo_map_buffer(const char * path, bool populate = false)
+{
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        bytefluo_throw_io_error("can't open file");
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        bytefluo_throw_io_error("can't get file size");
+    }
+    if (static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+        ::close(fd);
+        errno = EFBIG;
+        bytefluo_throw_io_error("can't map file");
+    }
+    const size_t len = static_cast<size_t>(st.st_size);
+    if (len == 0) {
+        ::close(fd); // an empty file can't be mapped
+        return bytefluo_buffer();
+    }
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate)
+        flags |= MAP_POPULATE;
+#endif
+    void * p = ::mmap(0, len, PROT_READ, flags, fd, 0);
+    const int err = errno;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        errno = err;
+        bytefluo_throw_io_error("can't map file");
+    }
+#ifndef MAP_POPULATE
+    if (populate)
+        ::madvise(p, len, MADV_WILLNEED);
+#endif
+    return bytefluo_buffer(p, len, [len](const void * map) {
+        ::munmap(const_cast<void *>(map), len);
+    });
+}
+
+
+// allocation of memory backed by 2 MiB pages, which need far fewer TLB
+// entries than ordinary pages to cover a large buffer, so random reads
+// from it miss the TLB less often
+class bytefluo_huge_pages {
+public:
+    static const size_t page_size = 2 * 1024 * 1024;
+
+    // how an allocation is backed
+    enum backing {
+        normal,         // ordinary pages
+        transparent,    // transparent huge pages, requested with madvise()
+        hugetlb         // huge pages reserved by the system, via MAP_HUGETLB
+    };
+
+    // return the address of 'size' bytes of zeroed memory, aligned to
+    // page_size if 'size' is at least page_size, and set '*how' if not
+    // null to how it is backed; reserved huge pages are used if there
+    // are enough of them, otherwise transparent huge pages are requested,
+    // otherwise the memory has ordinary pages; allocations smaller than
+    // page_size always have ordinary pages; throws std::bad_alloc
+    static void * allocate(size_t size, backing * how = 0)
+    {
+        if (how)
+            *how = normal;
+        const size_t len = mapping_len(size);
+        if (len == 0)
+            return 0;
+        if (len < page_size) {
+            void * p = ::mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+            return p;
+        }
+
+        // the page size must be given explicitly: munmap() of a mapping
+        // of the system's default huge page size, which may be 1 GiB,
+        // would fail for a length that is only a multiple of page_size
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+        const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+            | 21 << MAP_HUGE_SHIFT; // log2(page_size)
+        void * p = ::mmap(0, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p != MAP_FAILED) {
+            if (how)
+                *how = hugetlb;
+            return p;
+        }
+#endif
+
+        // map an extra page_size bytes so that a page_size-aligned range
+        // can be kept and the rest unmapped; the kernel can only back an
+        // aligned range with transparent huge pages
+        if (len > SIZE_MAX - page_size)
+            throw std::bad_alloc();
+        void * const q = ::mmap(0, len + page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (q == MAP_FAILED)
+            throw std::bad_alloc();
+        uint8_t * const raw = static_cast<uint8_t *>(q);
+        const size_t skip = (page_size - reinterpret_cast<uintptr_t>(raw) % page_size) % page_size;
+        if (skip)
+            ::munmap(raw, skip);
+        ::munmap(raw + skip + len, page_size - skip);
+#ifdef MADV_HUGEPAGE
+        if (::madvise(raw + skip, len, MADV_HUGEPAGE) == 0 && how)
+            *how = transparent;
+#endif
+        return raw + skip;
+    }
+
+    // free the memory at 'p', which allocate() returned for 'size' bytes
+    static void deallocate(void * p, size_t size)
+    {
+        if (p)
+            ::munmap(p, mapping_len(size));
+    }
+
+private:
+    // return the length of the mapping that holds 'size' bytes
+    static size_t mapping_len(size_t size)
+    {
+        const size_t unit = size < page_size
+            ? static_cast<size_t>(::sysconf(_SC_PAGESIZE)) : page_size;
+        if (size > SIZE_MAX - unit)
+            throw std::bad_alloc();
+        return (size + unit - 1) / unit * unit;
+    }
+};
+
+
+// a standard allocator of memory backed by huge pages where possible,
+// e.g. std::vector<uint8_t, bytefluo_huge_allocator<uint8_t> >
+template <typename T>
+class bytefluo_huge_allocator {
+public:
+    typedef T value_type;
+
+    bytefluo_huge_allocator()
+    {
+    }
+
+    template <typename U>
+    bytefluo_huge_allocator(const bytefluo_huge_allocator<U> &)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T *>(bytefluo_huge_pages::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T * p, size_t n)
+    {
+        bytefluo_huge_pages::deallocate(p, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const bytefluo_huge_allocator<T> &, const bytefluo_huge_allocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const bytefluo_huge_allocator<T> &, const bytefluo_huge_allocator<U> &)
+{
+    return false;
+}
+
+
+// return a bytefluo_buffer of 'size' zeroed bytes backed by huge pages
+// where possible (see bytefluo_huge_pages::allocate()), set 'dest' to
+// the bytes so the caller can fill them before sharing the buffer, and
+// set '*how' if not null to how the bytes are backed
+inline bytefluo_buffer bytefluo_huge_buffer(size_t size, uint8_t *& dest,
+    bytefluo_huge_pages::backing * how = 0)
+{
+    dest = static_cast<uint8_t *>(bytefluo_huge_pages::allocate(size, how));
+    return bytefluo_buffer(dest, size, [size](const void * p) {
+        bytefluo_huge_pages::deallocate(const_cast<void *>(p), size);
+    });
+}
+
+
+// return a bytefluo_buffer holding a copy of the bytes of the file at
+// 'path', read into memory backed by huge pages where possible, and set
+// '*how' if not null to how the bytes are backed
+inline bytefluo_buffer bytefluo_read_huge_buffer(const char * path,
+    bytefluo_huge_pages::backing * how = 0)
+{
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        bytefluo_throw_io_error("can't open file");
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        const int err = errno;
+        ::close(fd);
+        errno = err;
+        bytefluo_throw_io_error("can't get file size");
+    }
+    if (static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+        ::close(fd);
+        errno = EFBIG;
+        bytefluo_throw_io_error("can't read file");
+    }
+    const size_t len = static_cast<size_t>(st.st_size);
+    uint8_t * dest;
+    bytefluo_buffer result;
+    try {
+        result = bytefluo_huge_buffer(len, dest, how);
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    for (size_t done = 0; done < len; ) {
+        const ssize_t n = ::read(fd, dest + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            const int err = n < 0 ? errno : EIO; // the file shrank
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't read file");
+        }
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    return result;
+}
+
+
+// a bytefluo_reader_source that reads from an open file descriptor, such
+// as a pipe, a socket or stdin, that need not support seeking or mapping
+class bytefluo_fd_source : public bytefluo_reader_source {
+public:
+    // bytes will be read from 'fd' in chunks of up to 'chunk_size' bytes;
+    // 'fd' is not closed by the bytefluo_fd_source
+    explicit bytefluo_fd_source(int fd, size_t chunk_size = 65536)
+    : bytefluo_reader_source(fd_reader(fd), chunk_size)
+    {
+    }
+
+private:
+    // return a read_function that reads from 'fd', retrying if interrupted
+    static read_function fd_reader(int fd)
+    {
+        return [fd](void * dest, size_t len) -> size_t {
+            for (;;) {
+                const ssize_t n = ::read(fd, dest, len);
+                if (n >= 0)
+                    return static_cast<size_t>(n);
+                if (errno != EINTR)
+                    bytefluo_throw_io_error("can't read file");
+            }
+        };
+    }
+};
+
+
+// a bytefluo_source that reads a file in blocks, keeping up to
+// 'queue_depth' blocks in memory; where the system supports io_uring the
+// blocks are read asynchronously, so that several reads may be in flight
+// at once: sequential reads keep the following blocks in flight, and
+// prefetch() submits the reads for a batch of offsets together; where
+// io_uring is unavailable blocks are read synchronously with pread()
+class bytefluo_uring_source : public bytefluo_source {
+public:
+    // bytes will be read from the file at 'path' in blocks of 'block_size'
+    // bytes; use io_uring if 'use_io_uring' is true and the system allows
+    bytefluo_uring_source(const char * path, size_t block_size = 256 * 1024,
+        unsigned queue_depth = 8, bool use_io_uring = true)
+    : fd(-1), file_size(0), block_size(block_size), slots(queue_depth < 2 ? 2 : queue_depth),
+      clock(0), prev_block(no_block), pinned_block(no_block)
+    {
+        if (block_size == 0 || block_size > max_block_size)
+            throw bytefluo_exception(bytefluo_exception::invalid_argument,
+                "bytefluo: invalid block size");
+        fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            bytefluo_throw_io_error("can't open file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't get file size");
+        }
+        file_size = static_cast<uint64_t>(st.st_size);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i].data.resize(block_size);
+            slots[i].block = no_block;
+            slots[i].state = empty;
+            slots[i].len = 0;
+            slots[i].used = 0;
+            slots[i].awaited = false;
+        }
+#ifdef BYTEFLUO_HAS_IO_URING
+        ring.fd = -1;
+        if (use_io_uring)
+            setup_ring();
+#else
+        (void)use_io_uring;
+#endif
+    }
+
+    ~bytefluo_uring_source()
+    {
+#ifdef BYTEFLUO_HAS_IO_URING
+        if (ring.fd >= 0) {
+            // the kernel may still be writing to the buffers
+            try {
+                for (size_t i = 0; i < slots.size(); ++i)
+                    wait_for(i);
+            }
+            catch (...) {
+            }
+            close_ring();
+        }
+#endif
+        ::close(fd);
+    }
+
+    // return true iff blocks are read with io_uring
+    bool uses_io_uring() const
+    {
+#ifdef BYTEFLUO_HAS_IO_URING
+        return ring.fd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    virtual uint64_t size()
+    {
+        return file_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        if (pos > file_size)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        if (pos == file_size) {
+            data = 0;
+            return 0;
+        }
+        const size_t wanted = min_len ? min_len : 1;
+        uint64_t block = pos / block_size;
+        const bool sequential = block == prev_block + 1; // true for block 0 initially
+        prev_block = block;
+        pinned_block = block;
+        const slot & s = slots[load(block)];
+        if (sequential)
+            read_ahead(block);
+
+        const size_t offset = static_cast<size_t>(pos - block * block_size);
+        if (s.len - offset >= wanted || block * block_size + s.len == file_size) {
+            data = &s.data[0] + offset;
+            return s.len - offset;
+        }
+
+        // the bytes wanted straddle blocks; copy them to the scratch buffer
+        scratch.assign(s.data.begin() + offset, s.data.begin() + s.len);
+        while (scratch.size() < wanted && pos + scratch.size() < file_size) {
+            pinned_block = ++block;
+            const slot & next = slots[load(block)];
+            const size_t n = std::min(wanted - scratch.size(), next.len);
+            scratch.insert(scratch.end(), next.data.begin(), next.data.begin() + n);
+        }
+        data = &scratch[0];
+        return scratch.size();
+    }
+
+    // start reading the blocks holding the bytes at the 'n' given offsets,
+    // so that later reads at those offsets needn't wait; with io_uring
+    // the reads are submitted together; at most 'queue_depth' blocks are
+    // held at once, so offsets beyond that many blocks are ignored
+    void prefetch(const uint64_t * offsets, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            if (offsets[i] >= file_size)
+                continue;
+            const uint64_t block = offsets[i] / block_size;
+            if (find(block) != no_slot)
+                continue;
+            const size_t j = victim(false);
+            if (j == no_slot)
+                break;
+            start_read(j, block);
+        }
+        submit(0);
+    }
+
+private:
+    enum slot_state { empty, in_flight, ready, failed };
+    struct slot {
+        std::vector<uint8_t> data;
+        uint64_t block;         // the block held, or being read, or no_block
+        slot_state state;
+        size_t len;             // bytes in the block
+        int error;              // errno value if state is failed
+        uint64_t used;          // 'clock' when last used, for LRU replacement
+        bool awaited;           // read ahead or prefetched, and not yet used
+    };
+    static const uint64_t no_block = UINT64_MAX;
+    static const size_t no_slot = SIZE_MAX;
+    static const size_t max_block_size = 1 << 30;
+
+    int fd;
+    uint64_t file_size;
+    size_t block_size;
+    std::vector<slot> slots;
+    uint64_t clock;
+    uint64_t prev_block;        // the block holding the previous fetch() position
+    uint64_t pinned_block;      // the block the current fetch() must not evict
+    std::vector<uint8_t> scratch;
+
+#ifdef BYTEFLUO_HAS_IO_URING
+    struct ring_state {
+        int fd;                 // -1 if io_uring isn't used
+        void * sq_map;
+        size_t sq_map_len;
+        void * cq_map;          // the same as sq_map if the kernel maps both together
+        size_t cq_map_len;
+        io_uring_sqe * sqes;
+        size_t sqes_len;
+        unsigned * sq_tail;
+        unsigned * sq_mask;
+        unsigned * sq_array;
+        unsigned * cq_head;
+        unsigned * cq_tail;
+        unsigned * cq_mask;
+        io_uring_cqe * cqes;
+        unsigned unsubmitted;   // SQEs queued but not yet submitted
+        bool fixed;             // the slot buffers are registered with the kernel
+    } ring;
+
+    // set up an io_uring instance with the slot buffers registered; leave
+    // ring.fd as -1 if this isn't possible
+    void setup_ring()
+    {
+        io_uring_params params;
+        ::memset(&params, 0, sizeof(params));
+        const int rfd = static_cast<int>(::syscall(__NR_io_uring_setup,
+            static_cast<unsigned>(slots.size()), &params));
+        if (rfd < 0)
+            return;
+        ring.fd = rfd;
+        ring.sq_map = ring.cq_map = MAP_FAILED;
+        ring.sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+        ring.sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring.cq_map_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring.sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_map)
+            ring.sq_map_len = ring.cq_map_len = std::max(ring.sq_map_len, ring.cq_map_len);
+
+        ring.sq_map = ::mmap(0, ring.sq_map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQ_RING);
+        if (ring.sq_map != MAP_FAILED) {
+            ring.cq_map = single_map ? ring.sq_map : ::mmap(0, ring.cq_map_len,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_CQ_RING);
+        }
+        if (ring.cq_map != MAP_FAILED) {
+            ring.sqes = static_cast<io_uring_sqe *>(::mmap(0, ring.sqes_len,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, rfd, IORING_OFF_SQES));
+        }
+        if (ring.sqes == MAP_FAILED) {
+            close_ring();
+            return;
+        }
+
+        uint8_t * const sq = static_cast<uint8_t *>(ring.sq_map);
+        uint8_t * const cq = static_cast<uint8_t *>(ring.cq_map);
+        ring.sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        ring.sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        ring.sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        ring.cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        ring.cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        ring.cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        ring.cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        ring.unsubmitted = 0;
+
+        // registered buffers save the kernel mapping them on every read;
+        // registration may fail, e.g. if RLIMIT_MEMLOCK is low
+        std::vector<iovec> iov(slots.size());
+        for (size_t i = 0; i < slots.size(); ++i) {
+            iov[i].iov_base = &slots[i].data[0];
+            iov[i].iov_len = slots[i].data.size();
+        }
+        ring.fixed = ::syscall(__NR_io_uring_register, rfd, IORING_REGISTER_BUFFERS,
+            &iov[0], static_cast<unsigned>(iov.size())) == 0;
+    }
+
+    void close_ring()
+    {
+        if (ring.sqes != MAP_FAILED)
+            ::munmap(ring.sqes, ring.sqes_len);
+        if (ring.cq_map != MAP_FAILED && ring.cq_map != ring.sq_map)
+            ::munmap(ring.cq_map, ring.cq_map_len);
+        if (ring.sq_map != MAP_FAILED)
+            ::munmap(ring.sq_map, ring.sq_map_len);
+        ::close(ring.fd);
+        ring.fd = -1;
+    }
+
+    // record the completions the kernel has posted
+    void reap()
+    {
+        unsigned head = *ring.cq_head;
+        const unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe & cqe = ring.cqes[head & *ring.cq_mask];
+            slot & s = slots[static_cast<size_t>(cqe.user_data)];
+            if (cqe.res < 0) {
+                s.state = failed;
+                s.error = -cqe.res;
+            }
+            else if (static_cast<size_t>(cqe.res) < s.len) {
+                // a short read; read the rest synchronously
+                s.state = read_sync(s, static_cast<size_t>(cqe.res)) ? ready : failed;
+            }
+            else
+                s.state = ready;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+#endif
+
+    // submit any queued reads and, if 'wait' is true, wait for at least
+    // one read to complete
+    void submit(bool wait)
+    {
+#ifdef BYTEFLUO_HAS_IO_URING
+        if (ring.fd < 0 || (ring.unsubmitted == 0 && !wait))
+            return;
+        for (;;) {
+            const long n = ::syscall(__NR_io_uring_enter, ring.fd, ring.unsubmitted,
+                wait ? 1u : 0u, wait ? IORING_ENTER_GETEVENTS : 0u, 0, 0);
+            if (n >= 0) {
+                ring.unsubmitted -= static_cast<unsigned>(n);
+                if (ring.unsubmitted == 0)
+                    break;
+            }
+            else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                bytefluo_throw_io_error("can't submit read");
+        }
+        reap();
+#else
+        (void)wait;
+#endif
+    }
+
+    // read the rest of the block in 's' from offset 'done' with pread();
+    // return false, with s.error set, if this fails
+    bool read_sync(slot & s, size_t done)
+    {
+        const uint64_t offset = s.block * block_size;
+        while (done < s.len) {
+            const ssize_t n = ::pread(fd, &s.data[0] + done, s.len - done,
+                static_cast<off_t>(offset + done));
+            if (n > 0)
+                done += static_cast<size_t>(n);
+            else if (n == 0 || errno != EINTR) {
+                s.error = n == 0 ? EIO : errno; // n == 0: the file has shrunk
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // start reading 'block' into slot 'i'
+    void start_read(size_t i, uint64_t block)
+    {
+        slot & s = slots[i];
+        s.block = block;
+        s.len = static_cast<size_t>(std::min<uint64_t>(block_size, file_size - block * block_size));
+        s.used = ++clock;
+        s.awaited = true;
+#ifdef BYTEFLUO_HAS_IO_URING
+        if (ring.fd >= 0) {
+            const unsigned tail = *ring.sq_tail;
+            const unsigned index = tail & *ring.sq_mask;
+            io_uring_sqe & sqe = ring.sqes[index];
+            ::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = ring.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.off = block * block_size;
+            sqe.addr = reinterpret_cast<uintptr_t>(&s.data[0]);
+            sqe.len = static_cast<unsigned>(s.len);
+            if (ring.fixed)
+                sqe.buf_index = static_cast<uint16_t>(i);
+            sqe.user_data = i;
+            ring.sq_array[index] = index;
+            __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+            ++ring.unsubmitted;
+            s.state = in_flight;
+            return;
+        }
+#endif
+        s.state = read_sync(s, 0) ? ready : failed;
+    }
+
+    // wait until slot 'i' isn't being read
+    void wait_for(size_t i)
+    {
+        while (slots[i].state == in_flight)
+            submit(true);
+    }
+
+    // return the slot holding or reading 'block', or no_slot
+    size_t find(uint64_t block) const
+    {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].state != empty && slots[i].block == block)
+                return i;
+        }
+        return no_slot;
+    }
+
+    // return an empty slot, or else the least recently used slot not being
+    // read and not holding pinned_block, preferring slots already used to
+    // those read ahead or prefetched; if there is none, wait for a read to
+    // complete if 'may_wait' is true, otherwise return no_slot
+    size_t victim(bool may_wait)
+    {
+        for (;;) {
+            size_t best = no_slot;
+            for (size_t i = 0; i < slots.size(); ++i) {
+                const slot & s = slots[i];
+                if (s.state == empty)
+                    return i;
+                if (s.state == in_flight || s.block == pinned_block)
+                    continue;
+                if (best == no_slot || (slots[best].awaited && !s.awaited)
+                        || (slots[best].awaited == s.awaited && s.used < slots[best].used))
+                    best = i;
+            }
+            if (best != no_slot || !may_wait)
+                return best;
+            submit(true);
+        }
+    }
+
+    // return the slot holding 'block', reading it if necessary; if the read
+    // failed, retry it with pread() and throw io_error if that fails too
+    size_t load(uint64_t block)
+    {
+        size_t i = find(block);
+        if (i == no_slot) {
+            i = victim(true);
+            start_read(i, block);
+            submit(false);
+        }
+        wait_for(i);
+        slot & s = slots[i];
+        if (s.state == failed && !read_sync(s, 0)) {
+            s.state = empty;
+            errno = s.error;
+            bytefluo_throw_io_error("can't read file");
+        }
+        s.state = ready;
+        s.used = ++clock;
+        s.awaited = false;
+        return i;
+    }
+
+    // start reading the blocks following 'block', as far as free slots allow
+    void read_ahead(uint64_t block)
+    {
+        const uint64_t last_block = (file_size - 1) / block_size;
+        for (size_t n = 1; n < slots.size() && block + n <= last_block; ++n) {
+            if (find(block + n) != no_slot)
+                continue;
+            const size_t i = victim(false);
+            if (i == no_slot)
+                break;
+            start_read(i, block + n);
+        }
+        submit(false);
+    }
+};
+
+
+// a bytefluo_source that reads a file in pages with pread(), keeping the
+// most recently used pages in memory up to a fixed budget of bytes, for
+// random access to files much larger than the memory available
+class bytefluo_paged_source : public bytefluo_source {
+public:
+    // bytes will be read from the file at 'path' in pages of 'page_size'
+    // bytes, of which at most 'budget' bytes' worth, but at least one
+    // page, will be held at once
+    bytefluo_paged_source(const char * path, size_t page_size = 64 * 1024,
+        size_t budget = 64 * 1024 * 1024)
+    : fd(-1), file_size(0), page_size(page_size),
+      max_pages(page_size && budget / page_size ? budget / page_size : 1),
+      hit_count(0), miss_count(0), eviction_count(0)
+    {
+        if (page_size == 0)
+            throw bytefluo_exception(bytefluo_exception::invalid_argument,
+                "bytefluo: invalid page size");
+        fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            bytefluo_throw_io_error("can't open file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't get file size");
+        }
+        file_size = static_cast<uint64_t>(st.st_size);
+        index.reserve(max_pages);
+    }
+
+    ~bytefluo_paged_source()
+    {
+        ::close(fd);
+    }
+
+    virtual uint64_t size()
+    {
+        return file_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        if (pos > file_size)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        if (pos == file_size) {
+            data = 0;
+            return 0;
+        }
+        const size_t wanted = min_len ? min_len : 1;
+        uint64_t number = pos / page_size;
+        const page * pg = &load(number);
+        const size_t offset = static_cast<size_t>(pos - number * page_size);
+        if (pg->data.size() - offset >= wanted || number * page_size + pg->data.size() == file_size) {
+            data = &pg->data[0] + offset;
+            return pg->data.size() - offset;
+        }
+
+        // the bytes wanted straddle pages; copy them to the scratch buffer
+        scratch.assign(pg->data.begin() + offset, pg->data.end());
+        while (scratch.size() < wanted && pos + scratch.size() < file_size) {
+            pg = &load(++number);
+            const size_t n = std::min(wanted - scratch.size(), pg->data.size());
+            scratch.insert(scratch.end(), pg->data.begin(), pg->data.begin() + n);
+        }
+        data = &scratch[0];
+        return scratch.size();
+    }
+
+    // the number of page requests satisfied from memory
+    uint64_t hits() const { return hit_count; }
+
+    // the number of pages read from the file
+    uint64_t misses() const { return miss_count; }
+
+    // the number of pages dropped to keep within the budget
+    uint64_t evictions() const { return eviction_count; }
+
+private:
+    struct page {
+        uint64_t number;            // the page holds file bytes from number * page_size
+        std::vector<uint8_t> data;
+    };
+    typedef std::list<page> page_list;
+
+    int fd;
+    uint64_t file_size;
+    size_t page_size;
+    size_t max_pages;
+    page_list pages;                // most recently used first
+    std::unordered_map<uint64_t, page_list::iterator> index; // page number -> page
+    std::vector<uint8_t> scratch;
+    uint64_t hit_count;
+    uint64_t miss_count;
+    uint64_t eviction_count;
+
+    // return page 'number', reading it if it isn't held
+    const page & load(uint64_t number)
+    {
+        const auto found = index.find(number);
+        if (found != index.end()) {
+            ++hit_count;
+            pages.splice(pages.begin(), pages, found->second);
+            return pages.front();
+        }
+
+        // reuse the least recently used page if the budget is spent
+        if (pages.size() == max_pages) {
+            if (pages.back().number != no_page) {
+                index.erase(pages.back().number);
+                ++eviction_count;
+            }
+            pages.splice(pages.begin(), pages, std::prev(pages.end()));
+        }
+        else
+            pages.push_front(page());
+        page & pg = pages.front();
+        pg.number = no_page;
+        const uint64_t offset = number * page_size;
+        pg.data.resize(static_cast<size_t>(std::min<uint64_t>(page_size, file_size - offset)));
+        size_t done = 0;
+        while (done < pg.data.size()) {
+            const ssize_t n = ::pread(fd, &pg.data[0] + done, pg.data.size() - done,
+                static_cast<off_t>(offset + done));
+            if (n > 0)
+                done += static_cast<size_t>(n);
+            else if (n == 0 || errno != EINTR) {
+                // the page is left at the back of the list, unindexed, for reuse
+                pages.splice(pages.end(), pages, pages.begin());
+                if (n == 0)
+                    errno = EIO; // the file has shrunk
+                bytefluo_throw_io_error("can't read file");
+            }
+        }
+        ++miss_count;
+        pg.number = number;
+        index[number] = pages.begin();
+        return pg;
+    }
+
+    static const uint64_t no_page = UINT64_MAX;
+};
+
+
+// a bytefluo_source that reads a file with O_DIRECT, bypassing the
+// system's page cache, so that a one-off scan of a huge file doesn't
+// evict data other programs need; if 'double_buffer' is true the next
+// buffer is read on another thread while the current one is parsed
+class bytefluo_direct_source : public bytefluo_source {
+public:
+    // the alignment of buffer addresses, file offsets and read sizes
+    static const size_t alignment = 4096;
+
+    // bytes will be read from the file at 'path' into buffers of
+    // 'buffer_size' bytes, rounded up to a multiple of the alignment;
+    // use O_DIRECT if 'use_direct_io' is true and the file system allows
+    bytefluo_direct_source(const char * path, size_t buffer_size = 1024 * 1024,
+        bool double_buffer = true, bool use_direct_io = true)
+    : fd(-1), direct(false), file_size(0),
+      buffer_size(buffer_size < 2 * alignment ? 2 * alignment
+          : (buffer_size + alignment - 1) / alignment * alignment),
+      double_buffer(double_buffer), current(0), next_pos(no_pos)
+    {
+        bufs[0].data = bufs[1].data = 0;
+        bufs[0].pos = bufs[1].pos = no_pos;
+        bufs[0].len = bufs[1].len = 0;
+#ifdef O_DIRECT
+        if (use_direct_io) {
+            fd = ::open(path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+            direct = fd >= 0;
+        }
+#else
+        (void)use_direct_io;
+#endif
+        if (fd < 0)
+            fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            bytefluo_throw_io_error("can't open file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't get file size");
+        }
+        file_size = static_cast<uint64_t>(st.st_size);
+        for (int i = 0; i < 2; ++i) {
+            void * p = 0;
+            if (::posix_memalign(&p, alignment, this->buffer_size) != 0) {
+                ::free(bufs[0].data);
+                ::close(fd);
+                throw std::bad_alloc();
+            }
+            bufs[i].data = static_cast<uint8_t *>(p);
+        }
+    }
+
+    ~bytefluo_direct_source()
+    {
+        if (pending.valid())
+            pending.wait();
+        ::free(bufs[0].data);
+        ::free(bufs[1].data);
+        ::close(fd);
+    }
+
+    // return true iff the file is being read with O_DIRECT
+    bool uses_direct_io() const
+    {
+        return direct;
+    }
+
+    virtual uint64_t size()
+    {
+        return file_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        if (pos > file_size)
+            throw bytefluo_exception(
+                bytefluo_exception::attempt_to_seek_after_end,
+                "bytefluo: attempt to seek after end of data");
+        if (pos == file_size) {
+            data = 0;
+            return 0;
+        }
+        const size_t wanted = std::min<uint64_t>(min_len ? min_len : 1, file_size - pos);
+
+        // the fast path: the bytes are in the current buffer
+        const buffer * b = &bufs[current];
+        if (b->pos != no_pos && pos >= b->pos && pos - b->pos + wanted <= b->len) {
+            data = b->data + (pos - b->pos);
+            return b->len - static_cast<size_t>(pos - b->pos);
+        }
+
+        // unless the bytes straddle the end of the current buffer, start a
+        // new buffer at the aligned offset at or before 'pos', which will
+        // hold the bytes unless they are more than buffer_size - alignment
+        if (b->pos == no_pos || pos < b->pos || pos >= b->pos + b->len) {
+            b = &switch_to(pos - pos % alignment);
+            const size_t offset = static_cast<size_t>(pos - b->pos);
+            if (b->len - offset >= wanted) {
+                data = b->data + offset;
+                return b->len - offset;
+            }
+        }
+
+        // copy the bytes wanted from adjacent buffers to the scratch buffer
+        scratch.assign(b->data + (pos - b->pos), b->data + b->len);
+        while (scratch.size() < wanted) {
+            b = &switch_to(b->pos + b->len);
+            const size_t n = std::min(wanted - scratch.size(), b->len);
+            scratch.insert(scratch.end(), b->data, b->data + n);
+        }
+        data = &scratch[0];
+        return scratch.size();
+    }
+
+private:
+    struct buffer {
+        uint8_t * data;         // buffer_size bytes aligned to 'alignment'
+        uint64_t pos;           // file offset of data[0], or no_pos
+        size_t len;             // bytes held
+    };
+    static const uint64_t no_pos = UINT64_MAX;
+
+    int fd;
+    std::atomic<bool> direct;   // fd is open with O_DIRECT
+    uint64_t file_size;
+    size_t buffer_size;
+    bool double_buffer;
+    buffer bufs[2];
+    int current;                // index of the buffer reads are served from
+    std::future<size_t> pending; // the read of the next buffer, if in progress
+    uint64_t next_pos;          // file offset of the next buffer, if being read
+    std::vector<uint8_t> scratch;
+
+    // read up to buffer_size bytes at the aligned file offset 'pos' into
+    // 'data'; return the number of bytes read
+    size_t read_at(uint8_t * data, uint64_t pos)
+    {
+        const size_t len = static_cast<size_t>(std::min<uint64_t>(buffer_size, file_size - pos));
+        size_t done = 0;
+        while (done < len) {
+            // the request may run past the end of the file, but its size
+            // must be a multiple of the alignment
+            const size_t request = (len - done + alignment - 1) / alignment * alignment;
+            const ssize_t n = ::pread(fd, data + done, direct ? request : len - done,
+                static_cast<off_t>(pos + done));
+            if (n > 0)
+                done += static_cast<size_t>(n);
+            else if (n < 0 && errno == EINTR)
+                continue;
+            else if (n < 0 && errno == EINVAL && direct)
+                fall_back();
+            else {
+                if (n == 0)
+                    errno = EIO; // the file has shrunk
+                bytefluo_throw_io_error("can't read file");
+            }
+        }
+#ifdef POSIX_FADV_DONTNEED
+        if (!direct) {
+            // buffered reads: at least drop the pages read from the cache
+            ::posix_fadvise(fd, static_cast<off_t>(pos), static_cast<off_t>(len),
+                POSIX_FADV_DONTNEED);
+        }
+#endif
+        return std::min(done, len);
+    }
+
+    // reopen the file without O_DIRECT, which the file system refused
+    void fall_back()
+    {
+#ifdef O_DIRECT
+        const int flags = ::fcntl(fd, F_GETFL);
+        if (flags != -1 && ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+            direct = false;
+            return;
+        }
+#endif
+        errno = EINVAL;
+        bytefluo_throw_io_error("can't read file");
+    }
+
+    // make the buffer holding the bytes at aligned offset 'pos' current,
+    // using the buffer being read in the background if it is at 'pos',
+    // and start reading the following buffer if double buffering
+    const buffer & switch_to(uint64_t pos)
+    {
+        const int other = 1 - current;
+        if (pending.valid()) {
+            // the other buffer is being read; wait for it even if it
+            // isn't wanted, as the buffer can't be reused until then
+            const uint64_t p = next_pos;
+            next_pos = no_pos;
+            bufs[other].pos = no_pos;
+            const size_t len = pending.get();
+            bufs[other].pos = p;
+            bufs[other].len = len;
+        }
+        if (bufs[other].pos == pos)
+            current = other;
+        else {
+            buffer & b = bufs[current];
+            b.pos = no_pos;
+            b.len = read_at(b.data, pos);
+            b.pos = pos;
+        }
+
+        const buffer & b = bufs[current];
+        const uint64_t following = b.pos + b.len;
+        if (double_buffer && following < file_size) {
+            buffer & n = bufs[1 - current];
+            n.pos = no_pos;
+            next_pos = following;
+            uint8_t * const dest = n.data;
+            pending = std::async(std::launch::async, [this, dest, following] {
+                return read_at(dest, following);
+            });
+        }
+        return b;
+    }
+};
+
+
+// a bytefluo_ring whose storage is mapped twice, at adjacent addresses,
+// so that bytes which wrap around the end of the storage are contiguous
+// in memory and are never copied by a bytefluo_ring_source
+class bytefluo_mirrored_ring : public bytefluo_ring {
+public:
+    // the ring will hold at least 'capacity' bytes; the capacity is
+    // rounded up to a multiple of the page size
+    explicit bytefluo_mirrored_ring(size_t capacity)
+    : bytefluo_ring(map_storage(capacity), page_multiple(capacity), true)
+    {
+    }
+
+    ~bytefluo_mirrored_ring()
+    {
+        ::munmap(storage(), 2 * capacity());
+    }
+
+private:
+    static size_t page_multiple(size_t capacity)
+    {
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        return capacity < page ? page : (capacity + page - 1) / page * page;
+    }
+
+    // return the address of 'capacity' bytes of shared memory, rounded up
+    // to whole pages, mapped twice in succession
+    static uint8_t * map_storage(size_t capacity)
+    {
+        const size_t len = page_multiple(capacity);
+#if defined(MFD_CLOEXEC)
+        const int fd = ::memfd_create("bytefluo_ring", MFD_CLOEXEC);
+#else
+        // an anonymous shared memory object: unlinked as soon as it is opened
+        static std::atomic<unsigned> count(0);
+        const std::string name("/bytefluo_ring_" + std::to_string(::getpid())
+            + "_" + std::to_string(count++));
+        const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            ::shm_unlink(name.c_str());
+#endif
+        if (fd < 0)
+            bytefluo_throw_io_error("can't create ring buffer memory");
+        if (::ftruncate(fd, static_cast<off_t>(len)) != 0) {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't size ring buffer memory");
+        }
+        // reserve twice the address space, then map the memory over each half
+        void * const base = ::mmap(0, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        uint8_t * const p = static_cast<uint8_t *>(base);
+        if (base == MAP_FAILED
+            || ::mmap(p, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+            || ::mmap(p + len, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            const int err = errno;
+            if (base != MAP_FAILED)
+                ::munmap(base, 2 * len);
+            ::close(fd);
+            errno = err;
+            bytefluo_throw_io_error("can't map ring buffer memory");
+        }
+        ::close(fd);
+        return p;
+    }
+};
+
+
+#endif
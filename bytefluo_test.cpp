@@ -24,10 +24,17 @@
 */
 
 #include "bytefluo.h"
+#include "bytefluo_thread.h"
+#if !defined(_WIN32)
+#include "bytefluo_posix.h"
+#endif
 
 #include <iostream>
 #include <climits>
 #include <chrono>
+#include <algorithm>
+#include <string>
+#include <thread>
 
 
 namespace {
@@ -1020,6 +1027,2327 @@ void test_basic_functionality()
     }
 }
 
+void test_read_utf16()
+{
+    // "Aé€\U0001F600z" followed by 8 ASCII characters
+    const uint8_t be[] = {
+        0x00, 0x41, 0x00, 0xE9, 0x20, 0xAC, 0xD8, 0x3D, 0xDE, 0x00, 0x00, 0x7A,
+        0x00, 0x30, 0x00, 0x31, 0x00, 0x32, 0x00, 0x33,
+        0x00, 0x34, 0x00, 0x35, 0x00, 0x36, 0x00, 0x37,
+    };
+    const char utf8[] =
+        "A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80z01234567";
+    const size_t utf8_len = sizeof(utf8) - 1;
+
+    uint8_t le[sizeof(be)];
+    for (size_t i = 0; i < sizeof(be); i += 2) {
+        le[i] = be[i + 1];
+        le[i + 1] = be[i];
+    }
+
+    {
+        bytefluo buf(be, be + sizeof(be), bytefluo::little);
+        char out[64];
+        const size_t n = buf.read_utf16(out, sizeof(out), sizeof(be) / 2, bytefluo::big);
+        TEST_EQUAL(n, utf8_len);
+        TEST_EQUAL(::memcmp(out, utf8, utf8_len), 0);
+        TEST_EQUAL(buf.eos(), true);
+    }
+    {
+        bytefluo buf(le, le + sizeof(le), bytefluo::big);
+        char out[64];
+        const size_t n = buf.read_utf16_bytes(out, sizeof(out), sizeof(le), bytefluo::little);
+        TEST_EQUAL(n, utf8_len);
+        TEST_EQUAL(::memcmp(out, utf8, utf8_len), 0);
+        TEST_EQUAL(buf.eos(), true);
+    }
+    {
+        // the pure ASCII tail only
+        bytefluo buf(be, be + sizeof(be), bytefluo::big);
+        buf.seek_begin(12);
+        char out[8];
+        TEST_EQUAL(buf.read_utf16(out, sizeof(out), 8, bytefluo::big), 8);
+        TEST_EQUAL(::memcmp(out, "01234567", 8), 0);
+        TEST_EQUAL(buf.read_utf16(out, sizeof(out), 0, bytefluo::big), 0);
+    }
+    {
+        // the cursor doesn't move if there is an exception
+        bytefluo buf(be, be + sizeof(be), bytefluo::big);
+        char out[64];
+        TEST_EXCEPTION(buf.read_utf16(out, sizeof(out), sizeof(be) / 2 + 1, bytefluo::big),
+            bytefluo_exception::attempt_to_read_past_end);
+        TEST_EXCEPTION(buf.read_utf16(out, 12, sizeof(be) / 2, bytefluo::big),
+            bytefluo_exception::output_buffer_too_small);
+        TEST_EXCEPTION(buf.read_utf16_bytes(out, sizeof(out), 3, bytefluo::big),
+            bytefluo_exception::invalid_utf16);
+        TEST_EXCEPTION(buf.read_utf16(out, sizeof(out), 1, bytefluo::byte_order(99)),
+            bytefluo_exception::invalid_byte_order);
+        TEST_EQUAL(buf.tellg(), 0);
+    }
+    {
+        // unpaired surrogates
+        const uint8_t lone_high[] = { 0xD8, 0x3D, 0x00, 0x41 };
+        const uint8_t lone_low[] = { 0xDE, 0x00 };
+        char out[16];
+        bytefluo buf(lone_high, lone_high + sizeof(lone_high), bytefluo::big);
+        TEST_EXCEPTION(buf.read_utf16(out, sizeof(out), 2, bytefluo::big),
+            bytefluo_exception::invalid_utf16);
+        TEST_EXCEPTION(buf.read_utf16(out, sizeof(out), 1, bytefluo::big),
+            bytefluo_exception::invalid_utf16);
+        TEST_EQUAL(buf.tellg(), 0);
+        buf.set_data_range(lone_low, lone_low + sizeof(lone_low));
+        TEST_EXCEPTION(buf.read_utf16(out, sizeof(out), 1, bytefluo::big),
+            bytefluo_exception::invalid_utf16);
+    }
+}
+
+void test_decoding_source()
+{
+    const uint8_t bytes[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF
+    };
+    const char b64[] = "ABEiM0RVZneImaq7zN3u/w==";
+    const char hex[] = "00112233445566778899aabbCCDDEEFF";
+
+    // the same bytes read through every block size from 1 byte up, so that
+    // scalar reads straddle blocks in every possible way
+    for (size_t block_size = 1; block_size <= 20; ++block_size) {
+        bytefluo_decoding_source b64_src(b64, b64 + sizeof(b64) - 1,
+            bytefluo_decoding_source::base64, block_size);
+        bytefluo_decoding_source hex_src(hex, hex + sizeof(hex) - 1,
+            bytefluo_decoding_source::hex, block_size);
+        bytefluo_source * sources[2] = { &b64_src, &hex_src };
+        for (int i = 0; i < 2; ++i) {
+            bytefluo_stream buf(*sources[i], bytefluo::big);
+            TEST_EQUAL(buf.size(), 16);
+            uint8_t a;
+            uint16_t b;
+            uint32_t c;
+            uint64_t d;
+            uint8_t e;
+            buf >> a >> b >> c >> d;
+            TEST_EQUAL(a, 0x00);
+            TEST_EQUAL(b, 0x1122);
+            TEST_EQUAL(c, 0x33445566);
+            TEST_EQUAL(d, 0x778899AABBCCDDEEULL);
+            TEST_EQUAL(buf.tellg(), 15);
+            TEST_EQUAL(buf.eos(), false);
+            TEST_EXCEPTION(buf >> b, bytefluo_exception::attempt_to_read_past_end);
+            TEST_EQUAL(buf.tellg(), 15);
+            buf >> e;
+            TEST_EQUAL(e, 0xFF);
+            TEST_EQUAL(buf.eos(), true);
+
+            buf.seek_begin(3);
+            buf.read_le(b);
+            TEST_EQUAL(b, 0x4433);
+            buf.seek_current(-2);
+            buf.set_byte_order(bytefluo::little).read_le(c);
+            TEST_EQUAL(c, 0x66554433);
+            buf.seek_end(4);
+            buf >> c;
+            TEST_EQUAL(c, 0xFFEEDDCC);
+
+            uint8_t out[16];
+            buf.seek_begin(0);
+            buf.read(out, sizeof(out));
+            TEST_EQUAL(::memcmp(out, bytes, sizeof(bytes)), 0);
+            buf.seek_begin(1);
+            TEST_EXCEPTION(buf.read(out, sizeof(out)),
+                bytefluo_exception::attempt_to_read_past_end);
+            TEST_EQUAL(buf.tellg(), 1);
+            TEST_EXCEPTION(buf.seek_begin(17), bytefluo_exception::attempt_to_seek_after_end);
+            TEST_EXCEPTION(buf.seek_current(-2), bytefluo_exception::attempt_to_seek_before_beginning);
+            TEST_EXCEPTION(buf.seek_end(17), bytefluo_exception::attempt_to_seek_before_beginning);
+            TEST_EQUAL(buf.tellg(), 1);
+        }
+    }
+
+    {
+        // URL-safe alphabet
+        const char url[] = "-_-_AAE=";
+        bytefluo_decoding_source src(url, url + sizeof(url) - 1,
+            bytefluo_decoding_source::base64url);
+        bytefluo_stream buf(src, bytefluo::big);
+        TEST_EQUAL(buf.size(), 5);
+        uint32_t a;
+        uint8_t b;
+        buf >> a >> b;
+        TEST_EQUAL(a, 0xFBFFBF00);
+        TEST_EQUAL(b, 0x01);
+        TEST_EQUAL(buf.eos(), true);
+
+        // the same text without padding
+        bytefluo_decoding_source src2(url, url + sizeof(url) - 2,
+            bytefluo_decoding_source::base64url);
+        TEST_EQUAL(src2.size(), 5);
+    }
+
+    {
+        // bad text is reported when the block containing it is decoded
+        const char bad_b64[] = "AAAAAAAA*AAA";
+        bytefluo_decoding_source src(bad_b64, bad_b64 + sizeof(bad_b64) - 1,
+            bytefluo_decoding_source::base64, 3);
+        bytefluo_stream buf(src, bytefluo::big);
+        uint32_t a;
+        buf >> a;
+        TEST_EQUAL(a, 0);
+        TEST_EXCEPTION(buf >> a, bytefluo_exception::invalid_encoding);
+        TEST_EQUAL(buf.tellg(), 4);
+        buf.seek_begin(0);
+        buf >> a;
+        TEST_EQUAL(a, 0);
+
+        const char bad_hex[] = "0g";
+        bytefluo_decoding_source hex_src(bad_hex, bad_hex + 2,
+            bytefluo_decoding_source::hex);
+        bytefluo_stream hex_buf(hex_src, bytefluo::big);
+        uint8_t b;
+        TEST_EXCEPTION(hex_buf >> b, bytefluo_exception::invalid_encoding);
+
+        TEST_EXCEPTION(bytefluo_decoding_source(bad_hex, bad_hex + 1,
+            bytefluo_decoding_source::hex), bytefluo_exception::invalid_encoding);
+        TEST_EXCEPTION(bytefluo_decoding_source(bad_b64, bad_b64 + 5,
+            bytefluo_decoding_source::base64), bytefluo_exception::invalid_encoding);
+        TEST_EXCEPTION(bytefluo_decoding_source(bad_b64 + 1, bad_b64,
+            bytefluo_decoding_source::base64), bytefluo_exception::end_precedes_begin);
+    }
+
+    {
+        // empty text
+        bytefluo_decoding_source src(0, 0, bytefluo_decoding_source::base64);
+        bytefluo_stream buf(src, bytefluo::big);
+        TEST_EQUAL(buf.size(), 0);
+        TEST_EQUAL(buf.eos(), true);
+        uint8_t a;
+        TEST_EXCEPTION(buf >> a, bytefluo_exception::attempt_to_read_past_end);
+    }
+}
+
+void test_resync()
+{
+    // 4 corrupt bytes followed by 5-byte frames beginning with the marker 0x47,
+    // with a false marker in the corrupt data and one in the frame payload
+    const uint8_t data[] = {
+        0x47, 0x00, 0x47, 0x00,
+        0x47, 0x01, 0x02, 0x47, 0x04,
+        0x47, 0x11, 0x12, 0x13, 0x14,
+        0x47, 0x21, 0x22, 0x23, 0x24,
+        0x47, 0x31,
+    };
+    bytefluo buf(data, data + sizeof(data), bytefluo::big);
+
+    TEST_EQUAL(buf.resync(0x47, 5, 1), true);
+    TEST_EQUAL(buf.tellg(), 0);
+    TEST_EQUAL(buf.resync(0x47, 5, 3), true);
+    TEST_EQUAL(buf.tellg(), 4);
+    // already synchronised; the cursor stays put
+    TEST_EQUAL(buf.resync(0x47, 5, 4), true);
+    TEST_EQUAL(buf.tellg(), 4);
+    buf.seek_begin(0);
+    TEST_EQUAL(buf.resync(0x47, 5, 4), true);
+    TEST_EQUAL(buf.tellg(), 4);
+
+    // not enough frames left to confirm
+    buf.seek_begin(0);
+    TEST_EQUAL(buf.resync(0x47, 5, 5), false);
+    TEST_EQUAL(buf.tellg(), 0);
+    buf.seek_begin(5);
+    TEST_EQUAL(buf.resync(0x47, 5, 3), true);
+    TEST_EQUAL(buf.tellg(), 9);
+    TEST_EQUAL(buf.resync(0x99, 1, 1), false);
+    TEST_EQUAL(buf.tellg(), 9);
+    buf.seek_end(1);
+    TEST_EQUAL(buf.resync(0x47, 5, 1), false);
+    buf.seek_end(2);
+    TEST_EQUAL(buf.resync(0x47, 1000, 1), true);
+    TEST_EQUAL(buf.tellg(), sizeof(data) - 2);
+    TEST_EQUAL(buf.resync(0x47, 1000, 2), false);
+    TEST_EQUAL(buf.resync(0x47, SIZE_MAX, 1), true);
+    TEST_EQUAL(buf.tellg(), sizeof(data) - 2);
+    TEST_EQUAL(buf.resync(0x47, SIZE_MAX, 2), false);
+    buf.seek_end(0);
+    TEST_EQUAL(buf.resync(0x47, 1, 1), false);
+
+    TEST_EXCEPTION(buf.resync(0x47, 0, 1), bytefluo_exception::invalid_argument);
+    TEST_EXCEPTION(buf.resync(0x47, 1, 0), bytefluo_exception::invalid_argument);
+
+    bytefluo empty;
+    TEST_EQUAL(empty.resync(0x47, 188, 1), false);
+}
+
+void test_find_value()
+{
+    // twenty 32-bit big-endian values: 0, 1, ... 19, but with 7 at index 12 too
+    std::vector<uint8_t> vec;
+    for (uint32_t i = 0; i < 20; ++i) {
+        const uint32_t v = i == 12 ? 7 : i;
+        vec.push_back(uint8_t(v >> 24));
+        vec.push_back(uint8_t(v >> 16));
+        vec.push_back(uint8_t(v >> 8));
+        vec.push_back(uint8_t(v));
+    }
+    vec.push_back(0x13); // a partial scalar that will be ignored
+
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::big));
+    TEST_EQUAL(buf.find_value(uint32_t(0)), 0);
+    TEST_EQUAL(buf.find_value(uint32_t(7)), 7);
+    TEST_EQUAL(buf.find_value(uint32_t(10)), 10);
+    TEST_EQUAL(buf.find_value(uint32_t(19)), 19);
+    TEST_EQUAL(buf.find_value(uint32_t(12)), bytefluo::npos);
+    TEST_EQUAL(buf.find_value(int32_t(19)), 19);
+    TEST_EQUAL(buf.find_value(uint32_t(19), 19), bytefluo::npos);
+    TEST_EQUAL(buf.count_value(uint32_t(7)), 2);
+    TEST_EQUAL(buf.count_value(uint32_t(12)), 0);
+    TEST_EQUAL(buf.count_value(uint32_t(7), 12), 1);
+    TEST_EQUAL(buf.count_value(uint32_t(7), 0), 0);
+    TEST_EQUAL(buf.tellg(), 0);
+
+    // the index is relative to the cursor
+    buf.seek_begin(8 * 4);
+    TEST_EQUAL(buf.find_value(uint32_t(7)), 4);
+    TEST_EQUAL(buf.count_value(uint32_t(7)), 1);
+    TEST_EQUAL(buf.tellg(), 8 * 4);
+
+    // the same bytes seen as little-endian and as other scalar sizes
+    buf.seek_begin(0);
+    buf.set_byte_order(bytefluo::little);
+    TEST_EQUAL(buf.find_value(uint32_t(0x0B000000)), 11);
+    TEST_EQUAL(buf.find_value(uint16_t(0x0500)), 11);
+    TEST_EQUAL(buf.count_value(uint16_t(0)), 21);
+    TEST_EQUAL(buf.find_value(uint64_t(0x0B0000000A000000ULL)), 5);
+    TEST_EQUAL(buf.count_value(uint8_t(0x13)), 2);
+    TEST_EQUAL(buf.find_value(uint8_t(0x13), 80), 79);
+
+    TEST_EXCEPTION(buf.find_value(uint32_t(0), 21),
+        bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(buf.count_value(uint64_t(0), 11),
+        bytefluo_exception::attempt_to_read_past_end);
+
+    bytefluo empty;
+    TEST_EQUAL(empty.find_value(uint32_t(0)), bytefluo::npos);
+    TEST_EQUAL(empty.count_value(uint32_t(0)), 0);
+
+    // matches at and around the edges of the blocks searched at a time
+    std::vector<uint8_t> vec2;
+    for (uint16_t i = 0; i < 300; ++i) {
+        vec2.push_back(uint8_t(i));
+        vec2.push_back(uint8_t(i >> 8));
+    }
+    bytefluo buf2(bytefluo_from_vector(vec2, bytefluo::little));
+    const size_t edges[] = { 0, 1, 63, 64, 65, 127, 128, 191, 255, 256, 299 };
+    bool ok = true;
+    for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); ++e)
+        ok &= buf2.find_value(uint16_t(edges[e])) == edges[e];
+    TEST_EQUAL(ok, true);
+    TEST_EQUAL(buf2.find_value(uint16_t(300)), bytefluo::npos);
+    TEST_EQUAL(buf2.find_value(uint16_t(200), 200), bytefluo::npos);
+}
+
+// put the 'n' sorted values at 'sorted' into Eytzinger order at 'out'
+size_t eytzinger_layout(const uint32_t * sorted, size_t n, uint32_t * out, size_t i = 0, size_t k = 0)
+{
+    if (k < n) {
+        i = eytzinger_layout(sorted, n, out, i, 2 * k + 1);
+        out[k] = sorted[i++];
+        i = eytzinger_layout(sorted, n, out, i, 2 * k + 2);
+    }
+    return i;
+}
+
+void test_array_view()
+{
+    // 100 sorted big-endian keys: 0, 0, 10, 10, 20, 20, ... 490, 490
+    std::vector<uint32_t> keys;
+    std::vector<uint8_t> vec;
+    for (uint32_t i = 0; i < 100; ++i) {
+        const uint32_t v = i / 2 * 10;
+        keys.push_back(v);
+        vec.push_back(uint8_t(v >> 24));
+        vec.push_back(uint8_t(v >> 16));
+        vec.push_back(uint8_t(v >> 8));
+        vec.push_back(uint8_t(v));
+    }
+
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::big));
+    const be_array_view<uint32_t> view(buf.be_array<uint32_t>(100));
+    TEST_EQUAL(view.size(), 100);
+    TEST_EQUAL(view.end() - view.begin(), 100);
+    TEST_EQUAL(view[0], 0);
+    TEST_EQUAL(view[99], 490);
+    TEST_EQUAL(*(view.begin() + 3), 10);
+    TEST_EQUAL(view.begin()[5], 20);
+    TEST_EXCEPTION(view[100], bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(*view.end(), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(*(view.begin() - 1), bytefluo_exception::attempt_to_read_past_end);
+
+    // the standard algorithms work directly on the stored bytes
+    for (uint32_t key = 0; key <= 500; key += 5) {
+        const size_t expected_lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        const size_t expected_upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+        TEST_EQUAL(size_t(std::lower_bound(view.begin(), view.end(), key) - view.begin()),
+            expected_lower);
+        TEST_EQUAL(size_t(std::upper_bound(view.begin(), view.end(), key) - view.begin()),
+            expected_upper);
+        const std::pair<be_array_view<uint32_t>::iterator, be_array_view<uint32_t>::iterator>
+            range(std::equal_range(view.begin(), view.end(), key));
+        TEST_EQUAL(size_t(range.second - range.first), expected_upper - expected_lower);
+        TEST_EQUAL(view.lower_bound(key), expected_lower);
+    }
+
+    // every size of array, including empty
+    for (size_t n = 0; n <= 20; ++n) {
+        const be_array_view<uint32_t> v(&vec[0], n);
+        for (uint32_t key = 0; key <= 110; ++key) {
+            TEST_EQUAL(v.lower_bound(key),
+                size_t(std::lower_bound(keys.begin(), keys.begin() + n, key) - keys.begin()));
+        }
+    }
+
+    // Eytzinger-ordered little-endian keys
+    for (size_t n = 0; n <= 33; ++n) {
+        std::vector<uint32_t> sorted;
+        for (uint32_t i = 0; i < n; ++i)
+            sorted.push_back(i * 10 + 10);
+        std::vector<uint32_t> eytzinger(n + 1);
+        eytzinger_layout(sorted.empty() ? 0 : &sorted[0], n, &eytzinger[0]);
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; i < n; ++i)
+            for (int b = 0; b < 4; ++b)
+                bytes.push_back(uint8_t(eytzinger[i] >> (b * 8)));
+
+        const le_array_view<uint32_t> v(bytes.empty() ? 0 : &bytes[0], n);
+        for (uint32_t key = 0; key <= n * 10 + 15; ++key) {
+            const size_t i = v.eytzinger_lower_bound(key);
+            const size_t expected = std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin();
+            if (expected == n) {
+                TEST_EQUAL(i, bytefluo::npos);
+            }
+            else if (i == bytefluo::npos) {
+                TEST_FAILED();
+            }
+            else {
+                TEST_EQUAL(v[i], sorted[expected]);
+            }
+        }
+    }
+
+    // the view starts at the cursor and must fit in the data range
+    buf.seek_begin(2 * 4);
+    buf.set_byte_order(bytefluo::little);
+    const le_array_view<uint16_t> le(buf.le_array<uint16_t>(4));
+    TEST_EQUAL(le[0], 0);
+    TEST_EQUAL(le[1], 0x0A00);
+    TEST_EQUAL(buf.be_array<int64_t>(49)[0], 10LL << 32 | 10);
+    TEST_EXCEPTION(buf.be_array<int64_t>(50), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(buf.tellg(), 8);
+}
+
+void test_reduce()
+{
+    // 1000 32-bit big-endian values spanning the full range
+    std::vector<uint8_t> vec;
+    uint64_t expected_sum = 0;
+    int64_t expected_signed_sum = 0;
+    uint32_t expected_min = 0xFFFFFFFF, expected_max = 0;
+    int32_t expected_signed_min = 0x7FFFFFFF;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const uint32_t v = i * 4294967u + (i % 7) * 13;
+        expected_sum += v;
+        expected_signed_sum += int32_t(v);
+        expected_min = std::min(expected_min, v);
+        expected_max = std::max(expected_max, v);
+        expected_signed_min = std::min(expected_signed_min, int32_t(v));
+        vec.push_back(uint8_t(v >> 24));
+        vec.push_back(uint8_t(v >> 16));
+        vec.push_back(uint8_t(v >> 8));
+        vec.push_back(uint8_t(v));
+    }
+
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::big));
+    TEST_EQUAL(buf.reduce_sum<uint32_t>(1000), expected_sum);
+    TEST_EQUAL(buf.reduce_sum<int32_t>(1000), expected_signed_sum);
+    TEST_EQUAL(buf.reduce_min<uint32_t>(1000), expected_min);
+    TEST_EQUAL(buf.reduce_max<uint32_t>(1000), expected_max);
+    TEST_EQUAL(buf.reduce_minmax<uint32_t>(1000).first, expected_min);
+    TEST_EQUAL(buf.reduce_minmax<uint32_t>(1000).second, expected_max);
+    TEST_EQUAL(buf.reduce_min<int32_t>(1000), expected_signed_min);
+    TEST_EQUAL(buf.tellg(), 0);
+
+    // the sum of 64-bit scalars wraps
+    uint64_t expected_sum64 = 0;
+    for (size_t i = 0; i < vec.size(); i += 8) {
+        uint64_t v = 0;
+        for (size_t j = 0; j < 8; ++j)
+            v = v << 8 | vec[i + j];
+        expected_sum64 += v;
+    }
+    TEST_EQUAL(buf.reduce_sum<uint64_t>(500), expected_sum64);
+    buf.seek_end(8);
+    buf.set_byte_order(bytefluo::little);
+    uint64_t last;
+    buf.read_le(last);
+    buf.seek_end(8);
+    TEST_EQUAL(buf.reduce_sum<uint64_t>(1), last);
+    TEST_EQUAL(buf.reduce_min<uint64_t>(1), last);
+
+    // a few small hand-checked cases in little-endian order
+    const uint8_t data[] = { 0xFF, 0xFF, 0x02, 0x00, 0x00, 0x80, 0xFF, 0x7F };
+    bytefluo le(data, data + sizeof(data), bytefluo::little);
+    TEST_EQUAL(le.reduce_sum<int16_t>(4), -1 + 2 - 32768 + 32767);
+    TEST_EQUAL(le.reduce_sum<uint16_t>(4), 65535u + 2 + 32768 + 32767);
+    TEST_EQUAL(le.reduce_min<int16_t>(4), -32768);
+    TEST_EQUAL(le.reduce_max<int16_t>(4), 32767);
+    TEST_EQUAL(le.reduce_max<uint16_t>(4), 65535);
+    TEST_EQUAL(le.reduce_minmax<uint8_t>(8).first, 0);
+    TEST_EQUAL(le.reduce_minmax<uint8_t>(8).second, 0xFF);
+    TEST_EQUAL(le.reduce_sum<int8_t>(8), -1 - 1 + 2 + 0 + 0 - 128 - 1 + 127);
+
+    // empty arrays
+    TEST_EQUAL(le.reduce_sum<int16_t>(0), 0);
+    TEST_EQUAL(le.reduce_min<int16_t>(0), 32767);
+    TEST_EQUAL(le.reduce_max<int16_t>(0), -32768);
+
+    TEST_EXCEPTION(le.reduce_sum<uint16_t>(5), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(le.reduce_minmax<uint64_t>(2), bytefluo_exception::attempt_to_read_past_end);
+}
+
+void test_scan()
+{
+    // 150 16-bit big-endian values: i * 1000 - 70000 (as int16_t), i.e. the
+    // values wrap round, so signed and unsigned selections differ
+    std::vector<uint8_t> vec;
+    std::vector<uint16_t> values;
+    for (int i = 0; i < 150; ++i) {
+        const uint16_t v = uint16_t(i * 1000 - 70000);
+        values.push_back(v);
+        vec.push_back(uint8_t(v >> 8));
+        vec.push_back(uint8_t(v));
+    }
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::big));
+
+    const size_t n = values.size();
+    uint64_t bitmap[3];
+    const int16_t ranges[][2] = {
+        { -100, 100 }, { -32768, 32767 }, { 5000, 4999 }, { 0, 0 }, { 30000, 32767 }
+    };
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); ++r) {
+        const int16_t lo = ranges[r][0], hi = ranges[r][1];
+        {
+            ::memset(bitmap, 0xAA, sizeof(bitmap));
+            size_t expected_count = 0;
+            bool bits_ok = true;
+            const size_t count = buf.scan_range<int16_t>(n, lo, hi, bitmap);
+            for (size_t i = 0; i < 3 * 64; ++i) {
+                const bool expected = i < n && int16_t(values[i]) >= lo && int16_t(values[i]) <= hi;
+                expected_count += expected;
+                bits_ok &= expected == ((bitmap[i / 64] >> (i % 64) & 1) != 0);
+            }
+            TEST_EQUAL(count, expected_count);
+            TEST_EQUAL(bits_ok, true);
+        }
+        {
+            const uint16_t ulo = uint16_t(lo), uhi = uint16_t(hi);
+            size_t expected_count = 0;
+            bool bits_ok = true;
+            const size_t count = buf.scan_range<uint16_t>(n, ulo, uhi, bitmap);
+            for (size_t i = 0; i < n; ++i) {
+                const bool expected = values[i] >= ulo && values[i] <= uhi;
+                expected_count += expected;
+                bits_ok &= expected == ((bitmap[i / 64] >> (i % 64) & 1) != 0);
+            }
+            TEST_EQUAL(count, expected_count);
+            TEST_EQUAL(bits_ok, true);
+        }
+    }
+
+    TEST_EQUAL(buf.scan_range<int16_t>(n, -32768, 32767, bitmap), n);
+    TEST_EQUAL(bitmap[2], (uint64_t(1) << (n - 128)) - 1);
+
+    TEST_EQUAL(buf.scan_equal<uint16_t>(n, values[70], bitmap), 1);
+    TEST_EQUAL(bitmap[0], 0);
+    TEST_EQUAL(bitmap[1], uint64_t(1) << 6);
+    TEST_EQUAL(bitmap[2], 0);
+    TEST_EQUAL(buf.scan_not_equal<uint16_t>(n, values[70], bitmap), n - 1);
+    TEST_EQUAL(bitmap[1], ~(uint64_t(1) << 6));
+
+    // the same bytes as little-endian bytes pairs, starting at the cursor
+    buf.seek_begin(2);
+    buf.set_byte_order(bytefluo::little);
+    const uint16_t v1 = values[1];
+    TEST_EQUAL(buf.scan_equal<uint16_t>(2, uint16_t(v1 << 8 | v1 >> 8), bitmap), 1);
+    TEST_EQUAL(bitmap[0], 1);
+    TEST_EQUAL(buf.scan_range<uint8_t>(1, v1 >> 8, v1 >> 8, bitmap), 1);
+    TEST_EQUAL(buf.tellg(), 2);
+
+    TEST_EQUAL(buf.scan_equal<uint16_t>(0, 0, bitmap), 0);
+    TEST_EXCEPTION(buf.scan_range<uint16_t>(n, 0, 1, bitmap),
+        bytefluo_exception::attempt_to_read_past_end);
+}
+
+void test_gather()
+{
+    const uint8_t data[] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99
+    };
+    bytefluo buf(data, data + sizeof(data), bytefluo::big);
+    buf.seek_begin(5);
+
+    // more offsets than the prefetch distance, in no particular order
+    const size_t offsets[] = { 8, 0, 3, 3, 6, 1, 2, 7, 5, 4, 0, 8, 2 };
+    const size_t n = sizeof(offsets) / sizeof(offsets[0]);
+    for (size_t distance = 0; distance <= n + 1; ++distance) {
+        uint16_t be[n], le[n];
+        buf.gather_be(offsets, n, be, distance);
+        buf.gather_le(offsets, n, le, distance);
+        bool ok = true;
+        for (size_t i = 0; i < n; ++i) {
+            ok &= be[i] == (data[offsets[i]] << 8 | data[offsets[i] + 1]);
+            ok &= le[i] == (data[offsets[i] + 1] << 8 | data[offsets[i]]);
+        }
+        TEST_EQUAL(ok, true);
+    }
+
+    uint64_t v64[2];
+    const size_t offsets64[] = { 2, 1 };
+    buf.gather_be(offsets64, 2, v64);
+    TEST_EQUAL(v64[0], 0x2233445566778899ULL);
+    TEST_EQUAL(v64[1], 0x1122334455667788ULL);
+    buf.gather_le(offsets64, 0, v64);
+    TEST_EQUAL(buf.tellg(), 5);
+
+    // no scalar is read if any offset is bad
+    const size_t bad_offsets[] = { 0, 3, 9 };
+    uint16_t out[3] = { 0x9999, 0x9999, 0x9999 };
+    TEST_EXCEPTION(buf.gather_be(bad_offsets, 3, out),
+        bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(out[0], 0x9999);
+    TEST_EXCEPTION(buf.gather_le(offsets, 1, v64),
+        bytefluo_exception::attempt_to_read_past_end);
+
+    bytefluo empty;
+    uint8_t b;
+    TEST_EXCEPTION(empty.gather_be(offsets, 1, &b),
+        bytefluo_exception::attempt_to_read_past_end);
+}
+
+void test_block_lower_bound()
+{
+    // sorted little-endian signed keys, in pairs: -600, -600, -580, -580, ...
+    std::vector<int32_t> keys;
+    std::vector<uint8_t> vec;
+    for (int i = 0; i < 120; ++i) {
+        const int32_t v = (i - i % 2) * 10 - 600;
+        keys.push_back(v);
+        for (int b = 0; b < 4; ++b)
+            vec.push_back(uint8_t(uint32_t(v) >> (b * 8)));
+    }
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::little));
+
+    // every block size from 0 to 120, so every group arrangement occurs
+    bool ok = true;
+    for (size_t n = 0; n <= keys.size(); ++n) {
+        for (int32_t key = -610; key <= 600; key += 5) {
+            const size_t expected = std::lower_bound(keys.begin(), keys.begin() + n, key) - keys.begin();
+            ok &= buf.block_lower_bound(n, key) == expected;
+        }
+    }
+    TEST_EQUAL(ok, true);
+    TEST_EQUAL(buf.block_lower_bound(120, int32_t(-600)), 0);
+    TEST_EQUAL(buf.block_lower_bound(120, int32_t(-599)), 2);
+    TEST_EQUAL(buf.block_lower_bound(120, int32_t(600)), 120);
+
+    // the block begins at the cursor
+    buf.seek_begin(4 * 100);
+    TEST_EQUAL(buf.block_lower_bound(20, int32_t(-600)), 0);
+    TEST_EQUAL(buf.block_lower_bound(20, int32_t(400)), 0);
+    TEST_EQUAL(buf.block_lower_bound(20, int32_t(401)), 2);
+    TEST_EQUAL(buf.tellg(), 400);
+    TEST_EXCEPTION(buf.block_lower_bound(21, int32_t(0)),
+        bytefluo_exception::attempt_to_read_past_end);
+
+    // big-endian unsigned 16-bit keys
+    const uint8_t be[] = { 0x00, 0x01, 0x00, 0xFF, 0x01, 0x00, 0xFF, 0xFF };
+    bytefluo b(be, be + sizeof(be), bytefluo::big);
+    TEST_EQUAL(b.block_lower_bound(4, uint16_t(0x0000)), 0);
+    TEST_EQUAL(b.block_lower_bound(4, uint16_t(0x0100)), 2);
+    TEST_EQUAL(b.block_lower_bound(4, uint16_t(0x0101)), 3);
+    TEST_EQUAL(b.block_lower_bound(4, uint16_t(0xFFFF)), 3);
+}
+
+// return true iff the memcmp() order of the keys for a and b is the order of a and b
+template <typename value_type>
+bool key_order_ok(value_type a, value_type b, bytefluo_key::direction dir)
+{
+    uint8_t ka[sizeof(value_type)], kb[sizeof(value_type)];
+    bytefluo_key::encode(a, ka, dir);
+    bytefluo_key::encode(b, kb, dir);
+    const int c = ::memcmp(ka, kb, sizeof(value_type));
+    if (dir == bytefluo_key::descending)
+        return a < b ? c > 0 : a > b ? c < 0 : c == 0;
+    return a < b ? c < 0 : a > b ? c > 0 : c == 0;
+}
+
+template <typename value_type>
+bool key_round_trip_ok(value_type v, bytefluo_key::direction dir)
+{
+    uint8_t k[sizeof(value_type)];
+    bytefluo_key::encode(v, k, dir);
+    value_type out;
+    bytefluo(k, k + sizeof(k), bytefluo::little).read_key(out, dir);
+    return ::memcmp(&out, &v, sizeof(v)) == 0;
+}
+
+void test_keys()
+{
+    const bytefluo_key::direction dirs[2] = { bytefluo_key::ascending, bytefluo_key::descending };
+    const int32_t ints[] = { -2147483647 - 1, -65536, -1, 0, 1, 255, 256, 2147483647 };
+    const uint16_t ushorts[] = { 0, 1, 0x7FFF, 0x8000, 0xFFFF };
+    const double doubles[] = {
+        -std::numeric_limits<double>::infinity(), -1e300, -2.5, -1.0, -1e-300, -0.0,
+        0.0, 1e-300, 1.0, 2.5, 1e300, std::numeric_limits<double>::infinity()
+    };
+    const float floats[] = { -3.5f, -1e-30f, 0.0f, 1e-30f, 3.5f };
+
+    bool ok = true;
+    for (int d = 0; d < 2; ++d) {
+        for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+            ok &= key_round_trip_ok(ints[i], dirs[d]);
+            ok &= key_round_trip_ok(int8_t(ints[i]), dirs[d]);
+            ok &= key_round_trip_ok(int64_t(ints[i]) * 3, dirs[d]);
+            for (size_t j = 0; j < sizeof(ints) / sizeof(ints[0]); ++j) {
+                ok &= key_order_ok(ints[i], ints[j], dirs[d]);
+                ok &= key_order_ok(int16_t(ints[i] / 65536), int16_t(ints[j] / 65536), dirs[d]);
+                ok &= key_order_ok(int64_t(ints[i]) * 3, int64_t(ints[j]) * 3, dirs[d]);
+            }
+        }
+        for (size_t i = 0; i < sizeof(ushorts) / sizeof(ushorts[0]); ++i) {
+            ok &= key_round_trip_ok(ushorts[i], dirs[d]);
+            for (size_t j = 0; j < sizeof(ushorts) / sizeof(ushorts[0]); ++j)
+                ok &= key_order_ok(ushorts[i], ushorts[j], dirs[d]);
+        }
+        for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); ++i) {
+            ok &= key_round_trip_ok(doubles[i], dirs[d]);
+            for (size_t j = 0; j < sizeof(doubles) / sizeof(doubles[0]); ++j) {
+                // -0.0 == 0.0, but the keys are ordered -0.0 < 0.0
+                if (doubles[i] != 0.0 || doubles[j] != 0.0)
+                    ok &= key_order_ok(doubles[i], doubles[j], dirs[d]);
+            }
+        }
+        for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i) {
+            ok &= key_round_trip_ok(floats[i], dirs[d]);
+            for (size_t j = 0; j < sizeof(floats) / sizeof(floats[0]); ++j)
+                ok &= key_order_ok(floats[i], floats[j], dirs[d]);
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    {
+        // the key format is fixed: big-endian with the sign bit flipped
+        uint8_t k[4];
+        TEST_EQUAL(bytefluo_key::encode(int32_t(1), k) - k, 4);
+        TEST_EQUAL(::memcmp(k, "\x80\x00\x00\x01", 4), 0);
+        bytefluo_key::encode(int32_t(1), k, bytefluo_key::descending);
+        TEST_EQUAL(::memcmp(k, "\x7F\xFF\xFF\xFE", 4), 0);
+        bytefluo_key::encode(1.0f, k);
+        TEST_EQUAL(::memcmp(k, "\xBF\x80\x00\x00", 4), 0);
+    }
+
+    {
+        // bulk encoding and decoding
+        const int16_t values[5] = { 3, -3, 0, 32767, -32768 };
+        uint8_t keys[10];
+        TEST_EQUAL(bytefluo_key::encode_array(values, 5, keys, bytefluo_key::descending) - keys, 10);
+        bytefluo buf(keys, keys + sizeof(keys), bytefluo::little);
+        int16_t out[6];
+        buf.read_keys(out, 5, bytefluo_key::descending);
+        TEST_EQUAL(::memcmp(out, values, sizeof(values)), 0);
+        TEST_EQUAL(buf.eos(), true);
+        buf.seek_begin(2);
+        TEST_EXCEPTION(buf.read_keys(out, 5), bytefluo_exception::attempt_to_read_past_end);
+        TEST_EQUAL(buf.tellg(), 2);
+    }
+
+    {
+        // strings, including embedded zeros and prefixes of one another
+        const std::string strs[] = {
+            std::string(""), std::string("\0", 1), std::string("\0\0", 2),
+            std::string("\0a", 2), std::string("a"), std::string("a\0", 2),
+            std::string("a\0b", 3), std::string("ab"), std::string("b"),
+            std::string("\xFF"), std::string("\xFF\xFF"),
+        };
+        const size_t count = sizeof(strs) / sizeof(strs[0]);
+        for (int d = 0; d < 2; ++d) {
+            std::vector<std::vector<uint8_t> > keys(count);
+            for (size_t i = 0; i < count; ++i) {
+                keys[i].resize(bytefluo_key::encoded_string_size(strs[i].data(), strs[i].size()));
+                uint8_t * end = bytefluo_key::encode_string(strs[i].data(), strs[i].size(),
+                    &keys[i][0], dirs[d]);
+                ok &= size_t(end - &keys[i][0]) == keys[i].size();
+
+                // decode with a trailing int key to check the cursor
+                std::vector<uint8_t> composite(keys[i]);
+                composite.resize(composite.size() + 4);
+                bytefluo_key::encode(int32_t(-7), &composite[keys[i].size()]);
+                bytefluo buf(bytefluo_from_vector(composite, bytefluo::big));
+                char out[8];
+                const size_t len = buf.read_key_string(out, sizeof(out), dirs[d]);
+                ok &= std::string(out, len) == strs[i];
+                int32_t tail;
+                buf.read_key(tail);
+                ok &= tail == -7 && buf.eos();
+            }
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t j = 0; j < count; ++j) {
+                    const bool less = std::lexicographical_compare(
+                        keys[i].begin(), keys[i].end(), keys[j].begin(), keys[j].end());
+                    ok &= less == (d == 0 ? strs[i] < strs[j] : strs[j] < strs[i]);
+                }
+            }
+        }
+        TEST_EQUAL(ok, true);
+
+        uint8_t key[16];
+        uint8_t * end = bytefluo_key::encode_string("a\0b", 3, key);
+        char out[3];
+        bytefluo buf(key, end, bytefluo::big);
+        TEST_EXCEPTION(buf.read_key_string(out, 2), bytefluo_exception::output_buffer_too_small);
+        buf.set_data_range(key, end - 1);
+        TEST_EXCEPTION(buf.read_key_string(out, 3), bytefluo_exception::attempt_to_read_past_end);
+        key[2] = 0x02;
+        buf.set_data_range(key, end);
+        TEST_EXCEPTION(buf.read_key_string(out, 3), bytefluo_exception::invalid_encoding);
+        TEST_EQUAL(buf.tellg(), 0);
+    }
+}
+
+void test_hash()
+{
+    // published XXH64 test values
+    TEST_EQUAL(bytefluo::hash64("", 0), 0xEF46DB3751D8E999ULL);
+    TEST_EQUAL(bytefluo::hash64("abc", 3), 0x44BC2CF5AD770999ULL);
+    TEST_EQUAL(bytefluo::hash64("xxhash", 6), 0x32DD38952C4BC720ULL);
+    const char spam[] = "Nobody inspects the spammish repetition";
+    TEST_EQUAL(bytefluo::hash64(spam, sizeof(spam) - 1), 0xFBCEA83C8A378BF1ULL);
+    TEST_EQUAL(bytefluo::hash64("xxhash", 6, 1) != bytefluo::hash64("xxhash", 6), true);
+
+    // hash the bytes consumed by reads and seeks
+    std::vector<uint8_t> vec(100);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7);
+    bytefluo buf(bytefluo_from_vector(vec, bytefluo::big));
+    uint32_t u32;
+    uint16_t u16;
+    uint8_t bytes[40];
+    buf >> u16;
+    buf.begin_hash();
+    buf >> u32;
+    buf.read(bytes, sizeof(bytes));
+    buf.seek_current(10);
+    buf.read_le(u16);
+    TEST_EQUAL(buf.end_hash(), bytefluo::hash64(&vec[2], 4 + 40 + 10 + 2));
+
+    // re-reading after a backward seek doesn't change the range hashed
+    buf.seek_begin(3);
+    buf.begin_hash();
+    buf.seek_end(0);
+    buf.seek_current(-1);
+    TEST_EQUAL(buf.end_hash(99), bytefluo::hash64(&vec[3], 96, 99));
+
+    // nothing consumed
+    buf.begin_hash();
+    TEST_EQUAL(buf.end_hash(), bytefluo::hash64("", 0));
+    bytefluo empty;
+    empty.begin_hash();
+    TEST_EQUAL(empty.end_hash(), bytefluo::hash64("", 0));
+    TEST_EXCEPTION(empty.end_hash(), bytefluo_exception::invalid_hash_range);
+
+    TEST_EXCEPTION(buf.end_hash(), bytefluo_exception::invalid_hash_range);
+    buf.begin_hash();
+    buf.seek_current(-1);
+    TEST_EXCEPTION(buf.end_hash(), bytefluo_exception::invalid_hash_range);
+    buf.set_data_range(&vec[0], &vec[0] + 10);
+    TEST_EXCEPTION(buf.end_hash(), bytefluo_exception::invalid_hash_range);
+}
+
+void test_crc()
+{
+    // the standard check value is the CRC of "123456789"
+    const char check[] = "123456789";
+    bytefluo buf(check, check + 9, bytefluo::big);
+    TEST_EQUAL(buf.crc32(9), 0xCBF43926);
+    TEST_EQUAL(buf.crc32c(9), 0xE3069283);
+    TEST_EQUAL(buf.tellg(), 0);
+    TEST_EQUAL(buf.crc32c(0), 0);
+
+    // continue a CRC over consecutive ranges
+    const uint32_t first = buf.crc32c(4, 0, true);
+    TEST_EQUAL(buf.tellg(), 4);
+    TEST_EQUAL(buf.crc32c(5, first), 0xE3069283);
+    TEST_EQUAL(buf.tellg(), 4);
+    TEST_EQUAL(buf.crc32c(5, first, true), 0xE3069283);
+    TEST_EQUAL(buf.eos(), true);
+    buf.seek_begin(0);
+    const uint32_t first32 = buf.crc32(2, bytefluo::crc32_poly, 0, true);
+    TEST_EQUAL(buf.crc32(7, bytefluo::crc32_poly, first32), 0xCBF43926);
+    TEST_EQUAL(buf.tellg(), 2);
+    buf.seek_end(0);
+    TEST_EXCEPTION(buf.crc32c(1), bytefluo_exception::attempt_to_read_past_end);
+
+    // longer data, every length and alignment, against a bitwise reference
+    std::vector<uint8_t> vec(300);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 31 + 7);
+    bytefluo big(bytefluo_from_vector(vec, bytefluo::big));
+    const uint32_t polys[3] = { bytefluo::crc32_poly, bytefluo::crc32c_poly, 0xD5828281 };
+    bool ok = true;
+    for (int k = 0; k < 3; ++k) {
+        for (size_t start = 0; start < 9; ++start) {
+            for (size_t len = 0; len <= 40; ++len) {
+                uint32_t crc = 0xFFFFFFFF;
+                for (size_t i = start; i < start + len; ++i) {
+                    crc ^= vec[i];
+                    for (int b = 0; b < 8; ++b)
+                        crc = crc & 1 ? crc >> 1 ^ polys[k] : crc >> 1;
+                }
+                big.seek_begin(start);
+                ok &= big.crc32(len, polys[k]) == ~crc;
+            }
+        }
+
+        // combining the CRCs of the parts gives the CRC of the whole
+        big.seek_begin(0);
+        const uint32_t whole = big.crc32(vec.size(), polys[k]);
+        for (size_t split = 0; split <= vec.size(); split += 37) {
+            big.seek_begin(0);
+            const uint32_t a = big.crc32(split, polys[k], 0, true);
+            const uint32_t b = big.crc32(vec.size() - split, polys[k]);
+            ok &= bytefluo::crc_combine(a, b, vec.size() - split, polys[k]) == whole;
+        }
+    }
+    TEST_EQUAL(ok, true);
+}
+
+void test_inet_checksum()
+{
+    // the IPv4 header example from Wikipedia; its checksum is 0xB861
+    uint8_t header[20] = {
+        0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+        0x00, 0x00, 0xC0, 0xA8, 0x00, 0x01, 0xC0, 0xA8, 0x00, 0xC7
+    };
+    bytefluo buf(header, header + sizeof(header), bytefluo::little);
+    TEST_EQUAL(buf.inet_checksum(20), 0xB861);
+    TEST_EQUAL(buf.tellg(), 0);
+
+    // a header containing its checksum checks as 0
+    header[10] = 0xB8;
+    header[11] = 0x61;
+    TEST_EQUAL(buf.inet_checksum(20, 0, true), 0);
+    TEST_EQUAL(buf.eos(), true);
+    TEST_EXCEPTION(buf.inet_checksum(1), bytefluo_exception::attempt_to_read_past_end);
+
+    // every length and alignment, and some seeds, against a simple reference
+    std::vector<uint8_t> vec(100);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(0xFF - i * 3);
+    bytefluo data(bytefluo_from_vector(vec, bytefluo::big));
+    const uint32_t seeds[3] = { 0, 0x1234, 0xFFFFFFFF };
+    bool ok = true;
+    for (int k = 0; k < 3; ++k) {
+        for (size_t start = 0; start < 8; ++start) {
+            for (size_t len = 0; len <= 40; ++len) {
+                uint64_t sum = seeds[k];
+                for (size_t i = 0; i < len; i += 2)
+                    sum += uint32_t(vec[start + i]) << 8 | (i + 1 < len ? vec[start + i + 1] : 0);
+                while (sum >> 16)
+                    sum = (sum & 0xFFFF) + (sum >> 16);
+                data.seek_begin(start);
+                ok &= data.inet_checksum(len, seeds[k]) == uint16_t(~sum);
+            }
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    // several ranges in one call
+    const std::pair<size_t, size_t> ranges[3] = {
+        std::make_pair(size_t(0), size_t(20)),
+        std::make_pair(size_t(5), size_t(33)),
+        std::make_pair(size_t(100), size_t(0))
+    };
+    uint16_t out[3];
+    data.seek_begin(7);
+    data.inet_checksum_batch(ranges, 3, out, seeds);
+    data.seek_begin(0);
+    TEST_EQUAL(out[0], data.inet_checksum(20, seeds[0]));
+    data.seek_begin(5);
+    TEST_EQUAL(out[1], data.inet_checksum(33, seeds[1]));
+    TEST_EQUAL(out[2], uint16_t(~uint16_t(0xFFFF)));
+    data.inet_checksum_batch(ranges, 2, out);
+    TEST_EQUAL(out[1], data.inet_checksum(33));
+    TEST_EQUAL(data.tellg(), 5);
+
+    const std::pair<size_t, size_t> bad[2] = {
+        std::make_pair(size_t(0), size_t(20)), std::make_pair(size_t(90), size_t(11))
+    };
+    out[0] = 0x9999;
+    TEST_EXCEPTION(data.inet_checksum_batch(bad, 2, out),
+        bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(out[0], 0x9999);
+}
+
+void test_mismatch()
+{
+    std::vector<uint8_t> a(300), b(250);
+    for (size_t i = 0; i < a.size(); ++i)
+        a[i] = uint8_t(i * 7);
+    std::copy(a.begin(), a.begin() + b.size(), b.begin());
+    bytefluo buf_a(bytefluo_from_vector(a, bytefluo::big));
+    bytefluo buf_b(bytefluo_from_vector(b, bytefluo::little));
+
+    // no difference: limited by max_len or by the shorter remaining range
+    TEST_EQUAL(buf_a.mismatch(buf_b, 100), 100);
+    TEST_EQUAL(buf_a.mismatch(buf_b, 1000), 250);
+    TEST_EQUAL(buf_b.mismatch(buf_a, bytefluo::npos), 250);
+    TEST_EQUAL(buf_a.mismatch(buf_b, 0), 0);
+    TEST_EQUAL(buf_a.compare(buf_b, 250), 0);
+    TEST_EQUAL(buf_a.compare(buf_b, 0), 0);
+    TEST_EQUAL(buf_a.tellg(), 0);
+    TEST_EQUAL(buf_b.tellg(), 0);
+
+    // a single difference at every offset, from several starting positions
+    bool ok = true;
+    for (size_t start = 0; start < 9; ++start) {
+        for (size_t pos = start; pos < b.size(); ++pos) {
+            b[pos] ^= 0x10;
+            buf_a.seek_begin(start);
+            buf_b.seek_begin(start);
+            ok &= buf_a.mismatch(buf_b, 1000) == pos - start;
+            ok &= (buf_a.compare(buf_b, b.size() - start) < 0) == (a[pos] < b[pos]);
+            ok &= buf_a.compare(buf_b, pos - start) == 0;
+            b[pos] ^= 0x10;
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    // advancing moves both cursors past the equal or compared bytes
+    b[77] = uint8_t(a[77] + 1);
+    buf_a.seek_begin(0);
+    buf_b.seek_begin(0);
+    TEST_EQUAL(buf_a.mismatch(buf_b, 1000, true), 77);
+    TEST_EQUAL(buf_a.tellg(), 77);
+    TEST_EQUAL(buf_b.tellg(), 77);
+    TEST_EQUAL(buf_a.compare(buf_b, 1, true) < 0, true);
+    TEST_EQUAL(buf_a.tellg(), 78);
+    TEST_EQUAL(buf_b.tellg(), 78);
+    TEST_EQUAL(buf_a.mismatch(buf_b, 1000, true), 250 - 78);
+    TEST_EQUAL(buf_b.eos(), true);
+    TEST_EQUAL(buf_a.mismatch(buf_b, 1000), 0);
+
+    // the compared range must lie within both objects
+    buf_a.seek_begin(0);
+    buf_b.seek_begin(0);
+    TEST_EXCEPTION(buf_a.compare(buf_b, 251), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(buf_b.compare(buf_a, 251), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(buf_a.tellg(), 0);
+
+    // comparing an object with itself moves its cursor once
+    TEST_EQUAL(buf_a.mismatch(buf_a, 10, true), 10);
+    TEST_EQUAL(buf_a.tellg(), 10);
+    TEST_EQUAL(buf_a.compare(buf_a, 10, true), 0);
+    TEST_EQUAL(buf_a.tellg(), 20);
+}
+
+void test_decode_dictionary()
+{
+    const double dict[5] = { 0.5, -1.25, 3.0, 1e10, -0.0 };
+    {
+        const uint8_t indices[] = { 0x00, 0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03 };
+        bytefluo buf(indices, indices + sizeof(indices), bytefluo::big);
+        double out[5] = { 9, 9, 9, 9, 9 };
+        buf.decode_dictionary<uint16_t>(4, dict, 5, out);
+        TEST_EQUAL(buf.tellg(), 8);
+        TEST_EQUAL(out[0], 3.0);
+        TEST_EQUAL(out[1], -0.0);
+        TEST_EQUAL(out[2], 0.5);
+        TEST_EQUAL(out[3], -1.25);
+        TEST_EQUAL(out[4], 9);
+        TEST_EXCEPTION(buf.decode_dictionary<uint16_t>(2, dict, 5, out),
+            bytefluo_exception::attempt_to_read_past_end);
+        buf.decode_dictionary<uint16_t>(1, dict, 5, out + 4);
+        TEST_EQUAL(out[4], 1e10);
+        TEST_EQUAL(buf.eos(), true);
+
+        // an index out of range is detected before anything is written
+        buf.seek_begin(0);
+        buf.set_byte_order(bytefluo::little);
+        out[0] = 9;
+        TEST_EXCEPTION(buf.decode_dictionary<uint16_t>(5, dict, 5, out),
+            bytefluo_exception::invalid_encoding);
+        TEST_EQUAL(out[0], 9);
+        TEST_EQUAL(buf.tellg(), 0);
+        buf.decode_dictionary<uint16_t>(0, dict, 0, out);
+        TEST_EQUAL(buf.tellg(), 0);
+    }
+    {
+        // signed indices are treated as unsigned, so negative ones are invalid
+        std::vector<uint8_t> vec(1000);
+        for (size_t i = 0; i < vec.size(); ++i)
+            vec[i] = uint8_t(i % 5);
+        bytefluo buf(bytefluo_from_vector(vec, bytefluo::little));
+        std::vector<double> out(vec.size());
+        buf.decode_dictionary<int8_t>(out.size(), dict, 5, &out[0]);
+        bool ok = true;
+        for (size_t i = 0; i < out.size(); ++i)
+            ok &= out[i] == dict[i % 5];
+        TEST_EQUAL(ok, true);
+        vec[500] = 0xFF;
+        buf.seek_begin(0);
+        TEST_EXCEPTION(buf.decode_dictionary<int8_t>(out.size(), dict, 5, &out[0]),
+            bytefluo_exception::invalid_encoding);
+    }
+}
+
+void test_decode_rle()
+{
+    // (uint8_t count, uint16_t value) pairs
+    const uint8_t data[] = {
+        0x03, 0x12, 0x34,
+        0x00, 0xFF, 0xFF,
+        0x01, 0xAB, 0xCD,
+        0xC8, 0x00, 0x07,
+        0x02, 0x00, 0x01,
+    };
+    bytefluo buf(data, data + sizeof(data), bytefluo::big);
+    std::vector<uint16_t> out(210, 0);
+    buf.decode_rle<uint8_t>(&out[0], 4);
+    TEST_EQUAL(buf.tellg(), 9);
+    TEST_EQUAL(out[0], 0x1234);
+    TEST_EQUAL(out[2], 0x1234);
+    TEST_EQUAL(out[3], 0xABCD);
+    TEST_EQUAL(out[4], 0);
+
+    // a run that would overflow the output is an error; the cursor stays put
+    TEST_EXCEPTION(buf.decode_rle<uint8_t>(&out[4], 199), bytefluo_exception::invalid_encoding);
+    TEST_EQUAL(buf.tellg(), 9);
+    buf.decode_rle<uint8_t>(&out[4], 202);
+    TEST_EQUAL(buf.eos(), true);
+    bool ok = true;
+    for (size_t i = 4; i < 204; ++i)
+        ok &= out[i] == 7;
+    TEST_EQUAL(ok, true);
+    TEST_EQUAL(out[204], 1);
+    TEST_EQUAL(out[205], 1);
+    TEST_EQUAL(out[206], 0);
+
+    // running out of pairs is an error too
+    buf.seek_begin(9);
+    TEST_EXCEPTION(buf.decode_rle<uint8_t>(&out[0], 203), bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(buf.tellg(), 9);
+    buf.decode_rle<uint8_t>(&out[0], 0);
+    TEST_EQUAL(buf.tellg(), 9);
+
+    // wider little-endian counts and signed values
+    const uint8_t pairs[] = {
+        0x05, 0x00, 0x00, 0x00, 0xFE, 0xFF, 0xFF, 0xFF, // 5 x -2
+        0x01, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, // 1 x 16
+    };
+    bytefluo buf2(pairs, pairs + sizeof(pairs), bytefluo::little);
+    int32_t iout[6];
+    buf2.decode_rle<uint32_t>(iout, 6);
+    TEST_EQUAL(buf2.eos(), true);
+    TEST_EQUAL(iout[0], -2);
+    TEST_EQUAL(iout[4], -2);
+    TEST_EQUAL(iout[5], 16);
+}
+
+void test_segmented_source()
+{
+    std::vector<uint8_t> vec(1000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7 + 3);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    // split the bytes into segments of pseudo-random lengths 0 to 12
+    std::vector<bytefluo_segmented_source::segment> segments;
+    uint64_t r = 88172645463325252ULL;
+    for (size_t pos = 0; pos < vec.size(); ) {
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+        const size_t len = std::min(size_t(r % 13), vec.size() - pos);
+        segments.push_back(std::make_pair(static_cast<const void *>(&vec[pos]), len));
+        pos += len;
+    }
+    segments.push_back(std::make_pair(static_cast<const void *>(0), size_t(0)));
+
+    bytefluo_segmented_source src(&segments[0], segments.size());
+    bytefluo_stream buf(src, bytefluo::big);
+    TEST_EQUAL(buf.size(), 1000);
+    bool ok = true;
+    while (whole.tellg() + 15 <= whole.size()) {
+        uint8_t a, a2;
+        uint16_t b, b2;
+        uint32_t c, c2;
+        uint64_t d, d2;
+        buf >> a >> b >> c >> d;
+        whole >> a2 >> b2 >> c2 >> d2;
+        ok &= a == a2 && b == b2 && c == c2 && d == d2;
+    }
+    TEST_EQUAL(ok, true);
+    uint8_t bytes[30], bytes2[30];
+    const size_t n = whole.size() - whole.tellg();
+    buf.read(bytes, n);
+    whole.read(bytes2, n);
+    TEST_EQUAL(::memcmp(bytes, bytes2, n), 0);
+    TEST_EQUAL(buf.eos(), true);
+
+    // seeks in both directions
+    ok = true;
+    for (size_t pos = 0; pos + 8 <= vec.size(); pos += 37) {
+        const size_t p = vec.size() - 8 - pos;
+        uint64_t x, y;
+        buf.seek_begin(p);
+        whole.seek_begin(p);
+        buf >> x;
+        whole >> y;
+        ok &= x == y;
+    }
+    TEST_EQUAL(ok, true);
+    std::vector<uint8_t> all(vec.size());
+    buf.seek_begin(0);
+    buf.read(&all[0], all.size());
+    TEST_EQUAL(all == vec, true);
+    TEST_EXCEPTION(buf.seek_begin(1001), bytefluo_exception::attempt_to_seek_after_end);
+    buf.seek_end(1);
+    uint16_t x;
+    TEST_EXCEPTION(buf >> x, bytefluo_exception::attempt_to_read_past_end);
+    TEST_EQUAL(buf.tellg(), 999);
+
+    // a header straddling two segments
+    const uint8_t part1[3] = { 0x11, 0x22, 0x33 };
+    const uint8_t part2[2] = { 0x44, 0x55 };
+    const bytefluo_segmented_source::segment parts[2] = {
+        std::make_pair(static_cast<const void *>(part1), size_t(3)),
+        std::make_pair(static_cast<const void *>(part2), size_t(2))
+    };
+    bytefluo_segmented_source src2(parts, 2);
+    bytefluo_stream buf2(src2, bytefluo::little);
+    uint8_t a;
+    uint32_t b;
+    buf2 >> a >> b;
+    TEST_EQUAL(a, 0x11);
+    TEST_EQUAL(b, 0x55443322u);
+    TEST_EQUAL(buf2.eos(), true);
+
+    // no segments, or only empty ones
+    bytefluo_segmented_source src3(parts, 0);
+    bytefluo_stream buf3(src3, bytefluo::little);
+    TEST_EQUAL(buf3.size(), 0);
+    TEST_EQUAL(buf3.eos(), true);
+    TEST_EXCEPTION(buf3 >> a, bytefluo_exception::attempt_to_read_past_end);
+
+    const bytefluo_segmented_source::segment bad[1] = {
+        std::make_pair(static_cast<const void *>(0), size_t(1))
+    };
+    TEST_EXCEPTION(bytefluo_segmented_source(bad, 1), bytefluo_exception::null_begin_non_null_end);
+}
+
+
+// a read function that returns at most 'max_len' bytes per call
+class trickle_reader {
+public:
+    trickle_reader(const std::vector<uint8_t> & data, size_t max_len)
+    : calls(0), data(&data), pos(0), max_len(max_len)
+    {
+    }
+
+    size_t operator()(void * dest, size_t len)
+    {
+        ++*calls;
+        size_t n = std::min(std::min(len, max_len), data->size() - pos);
+        if (n)
+            ::memcpy(dest, &(*data)[pos], n);
+        pos += n;
+        return n;
+    }
+
+    int * calls;
+
+private:
+    const std::vector<uint8_t> * data;
+    size_t pos;
+    size_t max_len;
+};
+
+void test_reader_source()
+{
+    std::vector<uint8_t> vec(1000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7 + 1);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    // every combination of chunk size and read size, so that scalars and
+    // read()s straddle chunks in every possible way
+    bool ok = true;
+    for (size_t chunk_size = 1; chunk_size <= 12; ++chunk_size) {
+        for (size_t max_len = 1; max_len <= 13; max_len += 3) {
+            int calls = 0;
+            trickle_reader reader(vec, max_len);
+            reader.calls = &calls;
+            bytefluo_reader_source src(reader, chunk_size);
+            bytefluo_stream buf(src, bytefluo::big);
+            whole.seek_begin(0);
+            while (whole.tellg() + 15 <= whole.size()) {
+                uint8_t a, a2;
+                uint16_t b, b2;
+                uint32_t c, c2;
+                uint64_t d, d2;
+                buf >> a >> b >> c >> d;
+                whole >> a2 >> b2 >> c2 >> d2;
+                ok &= a == a2 && b == b2 && c == c2 && d == d2;
+            }
+            uint8_t bytes[30], bytes2[30];
+            const size_t n = whole.size() - whole.tellg();
+            buf.read(bytes, n);
+            whole.read(bytes2, n);
+            ok &= ::memcmp(bytes, bytes2, n) == 0;
+            ok &= buf.eos() && buf.tellg() == 1000;
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    int calls = 0;
+    trickle_reader reader(vec, 1000);
+    reader.calls = &calls;
+    bytefluo_reader_source src(reader, 16);
+    bytefluo_stream buf(src, bytefluo::little);
+    TEST_EQUAL(buf.size(), bytefluo_source::unknown_size);
+    TEST_EXCEPTION(buf.seek_end(0), bytefluo_exception::seek_not_supported);
+
+    // a read() much larger than the chunk size is copied a chunk at a time
+    std::vector<uint8_t> big(600);
+    buf.read(&big[0], big.size());
+    TEST_EQUAL(std::equal(big.begin(), big.end(), vec.begin()), true);
+    TEST_EQUAL(buf.tellg(), 600);
+    TEST_EQUAL(calls, 600 / 16 + 1);
+
+    // seeks backwards within the buffer work; before it they can't
+    buf.seek_current(-2);
+    uint16_t x;
+    buf >> x;
+    TEST_EQUAL(x, vec[599] << 8 | vec[598]);
+    TEST_EXCEPTION(buf.seek_begin(100), bytefluo_exception::seek_not_supported);
+    TEST_EQUAL(buf.tellg(), 600);
+
+    // seeks forwards skip the data
+    TEST_EQUAL(buf.seek_begin(900), 900);
+    buf >> x;
+    TEST_EQUAL(x, vec[901] << 8 | vec[900]);
+    TEST_EQUAL(buf.eos(), false);
+    TEST_EXCEPTION(buf.seek_begin(1001), bytefluo_exception::attempt_to_seek_after_end);
+    TEST_EQUAL(buf.tellg(), 902);
+    buf >> x;
+    TEST_EQUAL(x, vec[903] << 8 | vec[902]);
+    TEST_EQUAL(buf.seek_begin(1000), 1000);
+    TEST_EQUAL(buf.eos(), true);
+    TEST_EXCEPTION(buf >> x, bytefluo_exception::attempt_to_read_past_end);
+
+    // a failed seek far beyond the buffer keeps the bytes the stream
+    // hasn't read yet
+    {
+        trickle_reader reader2(vec, 1000);
+        reader2.calls = &calls;
+        bytefluo_reader_source src2(reader2, 16);
+        bytefluo_stream buf2(src2, bytefluo::big);
+        buf2.seek_begin(10);
+        TEST_EXCEPTION(buf2.seek_begin(5000), bytefluo_exception::attempt_to_seek_after_end);
+        TEST_EQUAL(buf2.tellg(), 10);
+        std::vector<uint8_t> rest(990);
+        buf2.read(&rest[0], rest.size());
+        TEST_EQUAL(std::equal(rest.begin(), rest.end(), vec.begin() + 10), true);
+        TEST_EQUAL(buf2.eos(), true);
+    }
+
+    // a read() past the end, spanning refills, throws and leaves the
+    // cursor where it was
+    {
+        std::vector<uint8_t> hundred(vec.begin(), vec.begin() + 100);
+        trickle_reader reader3(hundred, 1000);
+        reader3.calls = &calls;
+        bytefluo_reader_source src3(reader3, 16);
+        bytefluo_stream buf3(src3, bytefluo::big);
+        uint8_t out[150];
+        TEST_EXCEPTION(buf3.read(out, sizeof(out)), bytefluo_exception::attempt_to_read_past_end);
+        TEST_EQUAL(buf3.tellg(), 0);
+    }
+}
+
+
+// a read function that throws after returning 'good_len' bytes
+class failing_reader {
+public:
+    explicit failing_reader(size_t good_len)
+    : good_len(good_len), pos(0)
+    {
+    }
+
+    size_t operator()(void * dest, size_t len)
+    {
+        if (pos == good_len)
+            throw std::runtime_error("read failed");
+        const size_t n = std::min(len, good_len - pos);
+        ::memset(dest, 0xAB, n);
+        pos += n;
+        return n;
+    }
+
+private:
+    size_t good_len;
+    size_t pos;
+};
+
+void test_readahead_source()
+{
+    std::vector<uint8_t> vec(1000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7 + 1);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    // every combination of buffer size and read size, so that scalars and
+    // read()s straddle buffers in every possible way
+    bool ok = true;
+    for (size_t buffer_size = 1; buffer_size <= 12; ++buffer_size) {
+        for (size_t depth = 1; depth <= 4; ++depth) {
+            int calls = 0;
+            trickle_reader reader(vec, 1 + buffer_size % 5);
+            reader.calls = &calls;
+            bytefluo_readahead_source src(reader, buffer_size, depth);
+            bytefluo_stream buf(src, bytefluo::big);
+            whole.seek_begin(0);
+            while (whole.tellg() + 15 <= whole.size()) {
+                uint8_t a, a2;
+                uint16_t b, b2;
+                uint32_t c, c2;
+                uint64_t d, d2;
+                buf >> a >> b >> c >> d;
+                whole >> a2 >> b2 >> c2 >> d2;
+                ok &= a == a2 && b == b2 && c == c2 && d == d2;
+            }
+            uint8_t bytes[30], bytes2[30];
+            const size_t n = whole.size() - whole.tellg();
+            buf.read(bytes, n);
+            whole.read(bytes2, n);
+            ok &= ::memcmp(bytes, bytes2, n) == 0;
+            ok &= buf.eos() && buf.tellg() == 1000;
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    // a read() past the end, spanning buffers, throws and leaves the
+    // cursor where it was
+    {
+        int calls = 0;
+        std::vector<uint8_t> hundred(vec.begin(), vec.begin() + 100);
+        trickle_reader reader(hundred, 1000);
+        reader.calls = &calls;
+        bytefluo_readahead_source src(reader, 16, 2);
+        bytefluo_stream buf(src, bytefluo::big);
+        uint8_t out[150];
+        TEST_EXCEPTION(buf.read(out, sizeof(out)), bytefluo_exception::attempt_to_read_past_end);
+        TEST_EQUAL(buf.tellg(), 0);
+    }
+
+    {
+        int calls = 0;
+        trickle_reader reader(vec, 1000);
+        reader.calls = &calls;
+        bytefluo_readahead_source src(reader, 16, 3);
+        bytefluo_stream buf(src, bytefluo::little);
+        TEST_EQUAL(buf.size(), bytefluo_source::unknown_size);
+
+        // a scalar straddling two buffers, then seeks back over it
+        buf.seek_begin(14);
+        uint32_t x;
+        buf >> x;
+        TEST_EQUAL(x, uint32_t(vec[17]) << 24 | vec[16] << 16 | vec[15] << 8 | vec[14]);
+        buf.seek_current(-4);
+        buf >> x;
+        TEST_EQUAL(x, uint32_t(vec[17]) << 24 | vec[16] << 16 | vec[15] << 8 | vec[14]);
+        buf.seek_begin(15);
+        uint16_t y;
+        buf >> y;
+        TEST_EQUAL(y, vec[16] << 8 | vec[15]);
+        TEST_EXCEPTION(buf.seek_begin(10), bytefluo_exception::seek_not_supported);
+
+        std::vector<uint8_t> big(900);
+        buf.read(&big[0], big.size());
+        TEST_EQUAL(std::equal(big.begin(), big.end(), vec.begin() + 17), true);
+        TEST_EXCEPTION(buf.seek_begin(1001), bytefluo_exception::attempt_to_seek_after_end);
+        TEST_EQUAL(buf.tellg(), 917);
+        TEST_EQUAL(buf.seek_begin(1000), 1000);
+        TEST_EQUAL(buf.eos(), true);
+    }
+
+    // an exception thrown by the read function reaches the reader
+    {
+        bytefluo_readahead_source src(failing_reader(100), 16, 2);
+        bytefluo_stream buf(src, bytefluo::big);
+        std::vector<uint8_t> bytes(200);
+        buf.read(&bytes[0], 100);
+        bool got_exception = false;
+        try {
+            uint16_t y;
+            buf >> y;
+        }
+        catch (const std::runtime_error & e) {
+            got_exception = std::string(e.what()) == "read failed";
+        }
+        TEST_EQUAL(got_exception, true);
+        TEST_EQUAL(buf.tellg(), 100);
+    }
+
+    // destroying the source stops the I/O thread, even when it is waiting
+    // for a free buffer
+    {
+        int calls = 0;
+        trickle_reader reader(vec, 1000);
+        reader.calls = &calls;
+        bytefluo_readahead_source src(reader, 4, 2);
+        bytefluo_stream buf(src, bytefluo::big);
+        uint8_t a;
+        buf >> a;
+        TEST_EQUAL(a, vec[0]);
+    }
+}
+
+
+// write 'vec' to 'ring' in pseudo-random lengths from another thread,
+// while reading it back through a bytefluo_ring_source; return true iff
+// the bytes read match
+bool pass_through_ring(bytefluo_ring & ring, const std::vector<uint8_t> & vec)
+{
+    std::atomic<bool> abandoned(false);
+    std::thread producer([&ring, &vec, &abandoned] {
+        uint64_t r = 88172645463325252ULL;
+        for (size_t pos = 0; pos < vec.size() && !abandoned; ) {
+            r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+            const size_t len = std::min(size_t(r % 97), vec.size() - pos);
+            const size_t n = ring.write(&vec[pos], len);
+            if (n == 0)
+                std::this_thread::yield();
+            pos += n;
+        }
+        ring.close();
+    });
+
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+    bytefluo_ring_source src(ring);
+    bytefluo_stream buf(src, bytefluo::big);
+    bool ok = true;
+    try {
+        while (whole.tellg() + 15 <= whole.size()) {
+            uint8_t a, a2;
+            uint16_t b, b2;
+            uint32_t c, c2;
+            uint64_t d, d2;
+            buf >> a >> b >> c >> d;
+            whole >> a2 >> b2 >> c2 >> d2;
+            ok &= a == a2 && b == b2 && c == c2 && d == d2;
+            if (whole.tellg() % 1000 < 15) {
+                // skip forward, and read a block larger than the ring
+                const size_t n = std::min<size_t>(whole.size() - whole.tellg() - 15, 300);
+                std::vector<uint8_t> block(n), block2(n);
+                buf.read(block.empty() ? 0 : &block[0], n);
+                whole.read(block2.empty() ? 0 : &block2[0], n);
+                ok &= block == block2;
+                buf.seek_current(7);
+                whole.seek_current(7);
+            }
+        }
+        uint8_t bytes[30], bytes2[30];
+        const size_t n = whole.size() - whole.tellg();
+        buf.read(bytes, n);
+        whole.read(bytes2, n);
+        ok &= ::memcmp(bytes, bytes2, n) == 0;
+        ok &= buf.eos();
+    }
+    catch (...) {
+        ok = false;
+    }
+    abandoned = true;
+    producer.join();
+    return ok;
+}
+
+void test_ring_source()
+{
+    std::vector<uint8_t> vec(100000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7 + i / 256);
+
+    // producer and consumer threads, with the consumer's reads wrapping
+    // around the end of the ring
+    const size_t capacities[3] = { 64, 1000, 65536 };
+    for (int c = 0; c < 3; ++c) {
+        bytefluo_ring ring(capacities[c]);
+        TEST_EQUAL(ring.capacity(), capacities[c]);
+        TEST_EQUAL(pass_through_ring(ring, vec), true);
+    }
+
+    // one thread: bytes are released to the producer as the consumer
+    // fetches bytes beyond them
+    bytefluo_ring ring(10);
+    const uint8_t bytes[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF
+    };
+    TEST_EQUAL(ring.write(bytes, 4), 4);
+    bytefluo_ring_source src(ring);
+    bytefluo_stream buf(src, bytefluo::big);
+    TEST_EQUAL(buf.size(), bytefluo_source::unknown_size);
+    uint16_t y;
+    uint32_t z;
+    buf >> y;
+    TEST_EQUAL(y, 0x0011);
+    buf >> y;
+    TEST_EQUAL(y, 0x2233);
+    TEST_EQUAL(ring.write(bytes + 4, 12), 6);
+    buf >> z; // releases the first 4 bytes
+    TEST_EQUAL(z, 0x44556677u);
+    TEST_EQUAL(ring.write(bytes + 10, 6), 4);
+    buf >> z; // wraps around the end of the ring
+    TEST_EQUAL(z, 0x8899AABBu);
+    TEST_EQUAL(ring.write(bytes + 14, 2), 2);
+    ring.close();
+    buf >> z;
+    TEST_EQUAL(z, 0xCCDDEEFFu);
+    TEST_EQUAL(buf.eos(), true);
+    TEST_EQUAL(buf.tellg(), 16);
+    TEST_EXCEPTION(buf >> y, bytefluo_exception::attempt_to_read_past_end);
+    TEST_EXCEPTION(buf.seek_begin(0), bytefluo_exception::seek_not_supported);
+    TEST_EXCEPTION(buf.seek_begin(17), bytefluo_exception::attempt_to_seek_after_end);
+    TEST_EQUAL(buf.tellg(), 16);
+
+    // a consumer that outwaits its spin sleeps until the producer writes
+    // or closes the ring
+    {
+        bytefluo_ring slow(16);
+        std::thread producer([&slow, &bytes] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            slow.write(bytes, 4);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            slow.close();
+        });
+        bytefluo_ring_source slow_src(slow);
+        bytefluo_stream slow_buf(slow_src, bytefluo::big);
+        slow_buf >> z;
+        TEST_EQUAL(z, 0x00112233u);
+        TEST_EQUAL(slow_buf.eos(), true);
+        producer.join();
+    }
+
+    // a read() past the bytes written to a closed ring throws and leaves
+    // the cursor where it was
+    {
+        bytefluo_ring short_ring(64);
+        std::vector<uint8_t> fifty(vec.begin(), vec.begin() + 50);
+        TEST_EQUAL(short_ring.write(&fifty[0], fifty.size()), 50);
+        short_ring.close();
+        bytefluo_ring_source short_src(short_ring);
+        bytefluo_stream short_buf(short_src, bytefluo::big);
+        uint8_t out[60];
+        TEST_EXCEPTION(short_buf.read(out, sizeof(out)), bytefluo_exception::attempt_to_read_past_end);
+        TEST_EQUAL(short_buf.tellg(), 0);
+    }
+
+    // an empty ring
+    bytefluo_ring ring2(1);
+    ring2.close();
+    bytefluo_ring_source src2(ring2);
+    bytefluo_stream buf2(src2, bytefluo::big);
+    TEST_EQUAL(buf2.eos(), true);
+    TEST_EXCEPTION(buf2 >> y, bytefluo_exception::attempt_to_read_past_end);
+}
+
+
+void test_buffer()
+{
+    const uint8_t bytes[8] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77 };
+
+    {
+        bytefluo_buffer empty;
+        TEST_EQUAL(empty.size(), 0);
+        TEST_EQUAL(empty.empty(), true);
+        TEST_EQUAL(empty.data() == 0, true);
+        bytefluo_shared buf(empty, bytefluo::big);
+        TEST_EQUAL(buf.eos(), true);
+        TEST_EQUAL(bytefluo_buffer(0, 0).empty(), true);
+        TEST_EXCEPTION(bytefluo_buffer(0, 1), bytefluo_exception::null_begin_non_null_end);
+    }
+
+    // a copy of the bytes, which outlives its readers' source
+    {
+        std::vector<uint8_t> vec(bytes, bytes + 8);
+        bytefluo_buffer b(&vec[0], vec.size());
+        vec.assign(8, 0xFF);
+        TEST_EQUAL(b.size(), 8);
+        TEST_EQUAL(::memcmp(b.data(), bytes, 8), 0);
+        TEST_EQUAL(b.use_count(), 1);
+        bytefluo_shared buf(b, bytefluo::big);
+        TEST_EQUAL(b.use_count(), 2);
+        b = bytefluo_buffer();
+        uint32_t x;
+        buf.seek_begin(4);
+        buf >> x;
+        TEST_EQUAL(x, 0x44556677u);
+        TEST_EQUAL(buf.buffer().use_count(), 1);
+        bytefluo_shared buf2(buf);
+        TEST_EQUAL(buf.buffer().use_count(), 2);
+        buf2.seek_begin(0);
+        buf2 >> x;
+        TEST_EQUAL(x, 0x00112233u);
+    }
+
+    // the bytes of a vector, taken without copying
+    {
+        std::vector<uint8_t> vec(bytes, bytes + 8);
+        const uint8_t * const p = &vec[0];
+        bytefluo_buffer b(std::move(vec));
+        TEST_EQUAL(b.data() == p, true);
+        TEST_EQUAL(b.size(), 8);
+        TEST_EQUAL(bytefluo_buffer(std::vector<uint8_t>()).empty(), true);
+    }
+
+    // bytes freed by a custom deleter, once the last slice is destroyed
+    {
+        int deleted = 0;
+        uint8_t * const p = new uint8_t[8];
+        ::memcpy(p, bytes, 8);
+        bytefluo_buffer slice;
+        {
+            bytefluo_buffer b(p, 8, [&deleted](const void * q) {
+                delete [] static_cast<const uint8_t *>(q);
+                ++deleted;
+            });
+            slice = b.slice(2, 4);
+            TEST_EQUAL(b.use_count(), 2);
+        }
+        TEST_EQUAL(deleted, 0);
+        TEST_EQUAL(slice.data() == p + 2, true);
+        TEST_EQUAL(slice.size(), 4);
+        bytefluo_buffer slice2(slice.slice(1, 3));
+        TEST_EQUAL(slice2.data() == p + 3, true);
+        TEST_EQUAL(slice.slice(4, 0).empty(), true);
+        TEST_EXCEPTION(slice.slice(5, 0), bytefluo_exception::attempt_to_seek_after_end);
+        TEST_EXCEPTION(slice.slice(1, 4), bytefluo_exception::attempt_to_read_past_end);
+        bytefluo_shared buf(slice2, bytefluo::little);
+        slice = slice2 = bytefluo_buffer();
+        TEST_EQUAL(deleted, 0);
+        uint16_t x;
+        buf >> x;
+        TEST_EQUAL(x, 0x4433);
+        TEST_EQUAL(buf.size(), 3);
+        buf = bytefluo_shared(bytefluo_buffer(), bytefluo::little);
+        TEST_EQUAL(deleted, 1);
+    }
+
+    // slices passed to other threads, which outlive the whole buffer
+    {
+        std::vector<uint8_t> vec(100000);
+        for (size_t i = 0; i < vec.size(); ++i)
+            vec[i] = uint8_t(i * 7 + i / 256);
+        const std::vector<uint8_t> copy(vec);
+        bytefluo_buffer b(std::move(vec));
+        std::vector<std::thread> threads;
+        std::vector<uint32_t> sums(4);
+        for (size_t t = 0; t < 4; ++t) {
+            bytefluo_buffer part(b.slice(t * 25000, 25000));
+            threads.push_back(std::thread([part, &sums, t] {
+                bytefluo_shared buf(part, bytefluo::big);
+                uint32_t sum = 0;
+                while (!buf.eos()) {
+                    uint8_t c;
+                    buf >> c;
+                    sum += c;
+                }
+                sums[t] = sum;
+            }));
+        }
+        b = bytefluo_buffer();
+        uint32_t expected = 0, total = 0;
+        for (size_t t = 0; t < 4; ++t) {
+            threads[t].join();
+            total += sums[t];
+        }
+        for (size_t i = 0; i < copy.size(); ++i)
+            expected += copy[i];
+        TEST_EQUAL(total, expected);
+    }
+}
+
+#if !defined(_WIN32)
+
+// write 'bytes' to a new temporary file and return its path
+std::string make_temp_file(const std::vector<uint8_t> & bytes)
+{
+    char path[] = "/tmp/bytefluo_test_XXXXXX";
+    const int fd = ::mkstemp(path);
+    if (fd < 0)
+        throw std::runtime_error("can't create temporary file");
+    size_t done = 0;
+    while (done < bytes.size()) {
+        const ssize_t n = ::write(fd, &bytes[done], bytes.size() - done);
+        if (n <= 0) {
+            ::close(fd);
+            throw std::runtime_error("can't write temporary file");
+        }
+        done += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    return path;
+}
+
+void test_file()
+{
+    std::vector<uint8_t> vec(10000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 13);
+    const std::string path = make_temp_file(vec);
+
+    {
+        bytefluo_file file(path.c_str(), bytefluo::big);
+        TEST_EQUAL(file.size(), 10000);
+        TEST_EQUAL(file.tellg(), 0);
+        uint16_t a;
+        uint32_t b;
+        file >> a;
+        file.read_le(b);
+        TEST_EQUAL(a, 0x000D);
+        TEST_EQUAL(b, 0x4134271Au);
+        TEST_EQUAL(file.advise(bytefluo_file::sequential), true);
+        TEST_EQUAL(file.advise(bytefluo_file::random), true);
+        TEST_EQUAL(file.advise(bytefluo_file::willneed), true);
+        TEST_EQUAL(file.advise(bytefluo_file::normal), true);
+        file.advise(bytefluo_file::hugepage); // may legitimately be unsupported
+        file.seek_end(3);
+        file.prefetch(1000);
+        TEST_EQUAL(file.tellg(), 9997);
+        file.prefetch(0);
+        std::vector<uint8_t> tail(3);
+        file.read(&tail[0], 3);
+        TEST_EQUAL(tail[2], vec[9999]);
+        TEST_EQUAL(file.eos(), true);
+        TEST_EXCEPTION(file >> a, bytefluo_exception::attempt_to_read_past_end);
+
+        // the bytefluo API, here crc32c() and a copy, works on the mapping
+        file.seek_begin(0);
+        bytefluo copy(bytefluo_from_vector(vec, bytefluo::big));
+        TEST_EQUAL(file.crc32c(10000), copy.crc32c(10000));
+        bytefluo view(file);
+        TEST_EQUAL(view.mismatch(copy, bytefluo::npos), 10000);
+
+        // moving the file leaves the source empty
+        bytefluo_file moved(std::move(file));
+        TEST_EQUAL(moved.size(), 10000);
+        TEST_EQUAL(file.size(), 0);
+        TEST_EQUAL(moved.compare(copy, 10000), 0);
+    }
+    {
+        bytefluo_file file(path.c_str(), bytefluo::little, true);
+        uint32_t b;
+        file.seek_begin(1);
+        file >> b;
+        TEST_EQUAL(b, 0x34271A0Du);
+    }
+    ::unlink(path.c_str());
+
+    // an empty file is an empty range
+    const std::string empty_path = make_temp_file(std::vector<uint8_t>());
+    {
+        bytefluo_file file(empty_path.c_str(), bytefluo::big);
+        TEST_EQUAL(file.size(), 0);
+        TEST_EQUAL(file.eos(), true);
+        TEST_EQUAL(file.advise(bytefluo_file::sequential), true);
+        file.prefetch(10);
+    }
+    ::unlink(empty_path.c_str());
+
+    TEST_EXCEPTION(bytefluo_file(empty_path.c_str(), bytefluo::big), bytefluo_exception::io_error);
+    TEST_EXCEPTION(bytefluo_file("/tmp", bytefluo::big), bytefluo_exception::io_error);
+    TEST_EXCEPTION(bytefluo_file(path.c_str(), bytefluo::byte_order(99)),
+        bytefluo_exception::invalid_byte_order);
+}
+
+void test_map_buffer()
+{
+    std::vector<uint8_t> vec(10000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 13 + 7);
+    const std::string path = make_temp_file(vec);
+    bytefluo_buffer slice;
+    {
+        bytefluo_buffer b(bytefluo_map_buffer(path.c_str()));
+        TEST_EQUAL(b.size(), vec.size());
+        TEST_EQUAL(::memcmp(b.data(), &vec[0], vec.size()), 0);
+        slice = b.slice(9000, 1000);
+        TEST_EQUAL(bytefluo_map_buffer(path.c_str(), true).size(), vec.size());
+    }
+    // the file is still mapped while a slice of it exists
+    ::unlink(path.c_str());
+    bytefluo_shared buf(slice, bytefluo::big);
+    slice = bytefluo_buffer();
+    std::vector<uint8_t> tail(1000);
+    buf.read(&tail[0], tail.size());
+    TEST_EQUAL(std::equal(tail.begin(), tail.end(), vec.begin() + 9000), true);
+    TEST_EXCEPTION(bytefluo_map_buffer(path.c_str()), bytefluo_exception::io_error);
+
+    const std::string empty_path = make_temp_file(std::vector<uint8_t>());
+    TEST_EQUAL(bytefluo_map_buffer(empty_path.c_str()).empty(), true);
+    ::unlink(empty_path.c_str());
+}
+
+
+void test_fd_source()
+{
+    std::vector<uint8_t> vec(100000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 11);
+    const std::string path = make_temp_file(vec);
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    TEST_EQUAL(fd >= 0, true);
+    {
+        bytefluo_fd_source src(fd, 4096);
+        bytefluo_stream buf(src, bytefluo::big);
+        bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+        bool ok = true;
+        while (!whole.eos()) {
+            uint32_t a, b;
+            uint8_t c, d;
+            buf >> a >> c;
+            whole >> b >> d;
+            ok &= a == b && c == d;
+        }
+        TEST_EQUAL(ok, true);
+        TEST_EQUAL(buf.eos(), true);
+    }
+    ::close(fd);
+    ::unlink(path.c_str());
+
+    // data written to a pipe
+    int fds[2];
+    TEST_EQUAL(::pipe(fds), 0);
+    const uint8_t bytes[7] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+    TEST_EQUAL(::write(fds[1], bytes, 7), 7);
+    ::close(fds[1]);
+    {
+        bytefluo_fd_source src(fds[0], 4);
+        bytefluo_stream buf(src, bytefluo::little);
+        uint16_t a;
+        uint32_t b;
+        buf >> a >> b;
+        TEST_EQUAL(a, 0x0201);
+        TEST_EQUAL(b, 0x06050403u);
+        TEST_EXCEPTION(buf >> a, bytefluo_exception::attempt_to_read_past_end);
+        uint8_t c;
+        buf >> c;
+        TEST_EQUAL(c, 0x07);
+        TEST_EQUAL(buf.eos(), true);
+    }
+    ::close(fds[0]);
+
+    // a read error
+    {
+        bytefluo_fd_source src(-1);
+        bytefluo_stream buf(src, bytefluo::little);
+        uint8_t c;
+        TEST_EXCEPTION(buf >> c, bytefluo_exception::io_error);
+        TEST_EQUAL(buf.tellg(), 0);
+    }
+}
+
+void test_uring_source()
+{
+    std::vector<uint8_t> vec(100003);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 11 + i / 256);
+    const std::string path = make_temp_file(vec);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    const size_t block_sizes[3] = { 7, 1000, 65536 };
+    const unsigned depths[3] = { 1, 3, 8 };
+    bool ok = true;
+    for (int use_io_uring = 0; use_io_uring < 2; ++use_io_uring) {
+        for (int b = 0; b < 3; ++b) {
+            for (int d = 0; d < 3; ++d) {
+                bytefluo_uring_source src(path.c_str(), block_sizes[b], depths[d], use_io_uring != 0);
+                if (!use_io_uring)
+                    ok &= !src.uses_io_uring();
+                bytefluo_stream buf(src, bytefluo::big);
+                ok &= buf.size() == vec.size();
+
+                // sequential reads, straddling blocks in every way
+                whole.seek_begin(0);
+                while (whole.tellg() + 15 <= whole.size()) {
+                    uint8_t a, a2;
+                    uint16_t b, b2;
+                    uint32_t c, c2;
+                    uint64_t d, d2;
+                    buf >> a >> b >> c >> d;
+                    whole >> a2 >> b2 >> c2 >> d2;
+                    ok &= a == a2 && b == b2 && c == c2 && d == d2;
+                }
+                uint8_t bytes[30], bytes2[30];
+                const size_t n = whole.size() - whole.tellg();
+                buf.read(bytes, n);
+                whole.read(bytes2, n);
+                ok &= ::memcmp(bytes, bytes2, n) == 0;
+                ok &= buf.eos();
+
+                // random reads, each batch of offsets prefetched first
+                uint64_t r = 88172645463325252ULL;
+                for (int batch = 0; batch < 20; ++batch) {
+                    uint64_t offsets[8];
+                    for (int i = 0; i < 8; ++i) {
+                        r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+                        offsets[i] = r % (vec.size() - 3);
+                    }
+                    src.prefetch(offsets, 8);
+                    for (int i = 0; i < 8; ++i) {
+                        uint32_t x, y;
+                        buf.seek_begin(offsets[i]);
+                        whole.seek_begin(size_t(offsets[i]));
+                        buf >> x;
+                        whole >> y;
+                        ok &= x == y;
+                    }
+                }
+            }
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    {
+        bytefluo_uring_source src(path.c_str(), 4096, 4);
+        bytefluo_stream buf(src, bytefluo::little);
+        const uint64_t past_end[2] = { 100003, 999999 };
+        src.prefetch(past_end, 2);
+        buf.seek_end(2);
+        uint16_t x;
+        buf >> x;
+        TEST_EQUAL(x, vec[100002] << 8 | vec[100001]);
+        TEST_EQUAL(buf.eos(), true);
+        TEST_EXCEPTION(buf >> x, bytefluo_exception::attempt_to_read_past_end);
+        TEST_EXCEPTION(buf.seek_begin(100004), bytefluo_exception::attempt_to_seek_after_end);
+        std::vector<uint8_t> all(vec.size());
+        buf.seek_begin(0);
+        buf.read(&all[0], all.size());
+        TEST_EQUAL(all == vec, true);
+    }
+    ::unlink(path.c_str());
+
+    TEST_EXCEPTION(bytefluo_uring_source(path.c_str()), bytefluo_exception::io_error);
+    TEST_EXCEPTION(bytefluo_uring_source(path.c_str(), 0), bytefluo_exception::invalid_argument);
+
+    const std::string empty_path = make_temp_file(std::vector<uint8_t>());
+    {
+        bytefluo_uring_source src(empty_path.c_str());
+        bytefluo_stream buf(src, bytefluo::little);
+        TEST_EQUAL(buf.size(), 0);
+        TEST_EQUAL(buf.eos(), true);
+        uint8_t c;
+        TEST_EXCEPTION(buf >> c, bytefluo_exception::attempt_to_read_past_end);
+    }
+    ::unlink(empty_path.c_str());
+}
+
+void test_paged_source()
+{
+    std::vector<uint8_t> vec(10007);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 13 + i / 256);
+    const std::string path = make_temp_file(vec);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    // every page size from 1 byte up, so that reads straddle pages in
+    // every possible way, with budgets of one page and of several
+    bool ok = true;
+    for (size_t page_size = 1; page_size <= 17; ++page_size) {
+        for (size_t pages = 1; pages <= 4; pages += 3) {
+            bytefluo_paged_source src(path.c_str(), page_size, page_size * pages);
+            bytefluo_stream buf(src, bytefluo::big);
+            ok &= buf.size() == vec.size();
+            whole.seek_begin(0);
+            while (whole.tellg() + 15 <= whole.size()) {
+                uint8_t a, a2;
+                uint16_t b, b2;
+                uint32_t c, c2;
+                uint64_t d, d2;
+                buf >> a >> b >> c >> d;
+                whole >> a2 >> b2 >> c2 >> d2;
+                ok &= a == a2 && b == b2 && c == c2 && d == d2;
+            }
+            uint8_t bytes[30], bytes2[30];
+            const size_t n = whole.size() - whole.tellg();
+            buf.read(bytes, n);
+            whole.read(bytes2, n);
+            ok &= ::memcmp(bytes, bytes2, n) == 0;
+            ok &= buf.eos();
+            ok &= src.misses() >= (vec.size() + page_size - 1) / page_size;
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    {
+        // ten pages of 1000 bytes, and the 7 byte last page, with a budget of 3
+        bytefluo_paged_source src(path.c_str(), 1000, 3500);
+        bytefluo_stream buf(src, bytefluo::little);
+        uint16_t x;
+        buf.seek_begin(10);
+        buf >> x;
+        TEST_EQUAL(src.misses(), 1);
+        TEST_EQUAL(src.hits(), 0);
+        buf.seek_begin(5000);
+        buf >> x;
+        buf.seek_begin(9000);
+        buf >> x;
+        TEST_EQUAL(src.misses(), 3);
+        TEST_EQUAL(src.evictions(), 0);
+
+        // a hot page is a hit; then page 5 is the least recently used
+        buf.seek_begin(20);
+        buf >> x;
+        TEST_EQUAL(x, vec[21] << 8 | vec[20]);
+        TEST_EQUAL(src.hits(), 1);
+        buf.seek_begin(7000);
+        buf >> x;
+        TEST_EQUAL(src.misses(), 4);
+        TEST_EQUAL(src.evictions(), 1);
+        buf.seek_begin(30);
+        buf >> x;
+        TEST_EQUAL(src.hits(), 2);
+        buf.seek_begin(5000);
+        buf >> x;
+        TEST_EQUAL(src.misses(), 5);
+        TEST_EQUAL(src.evictions(), 2);
+
+        // a read straddling pages 8 and 9, and one in the short last page
+        buf.seek_begin(8999);
+        buf >> x;
+        TEST_EQUAL(x, vec[9000] << 8 | vec[8999]);
+        buf.seek_end(2);
+        buf >> x;
+        TEST_EQUAL(x, vec[10006] << 8 | vec[10005]);
+        TEST_EQUAL(buf.eos(), true);
+        TEST_EXCEPTION(buf >> x, bytefluo_exception::attempt_to_read_past_end);
+        TEST_EXCEPTION(buf.seek_begin(10008), bytefluo_exception::attempt_to_seek_after_end);
+
+        // a large read is copied a page at a time
+        std::vector<uint8_t> all(vec.size());
+        buf.seek_begin(0);
+        buf.read(&all[0], all.size());
+        TEST_EQUAL(all == vec, true);
+    }
+    ::unlink(path.c_str());
+
+    TEST_EXCEPTION(bytefluo_paged_source(path.c_str()), bytefluo_exception::io_error);
+    TEST_EXCEPTION(bytefluo_paged_source(path.c_str(), 0), bytefluo_exception::invalid_argument);
+}
+
+void test_direct_source()
+{
+    std::vector<uint8_t> vec(100003);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 17 + i / 256);
+    const std::string path = make_temp_file(vec);
+    bytefluo whole(bytefluo_from_vector(vec, bytefluo::big));
+
+    const size_t buffer_sizes[3] = { 1, 10000, 1024 * 1024 };
+    bool ok = true;
+    for (int direct = 0; direct < 2; ++direct) {
+        for (int double_buffer = 0; double_buffer < 2; ++double_buffer) {
+            for (int b = 0; b < 3; ++b) {
+                bytefluo_direct_source src(path.c_str(), buffer_sizes[b],
+                    double_buffer != 0, direct != 0);
+                if (!direct)
+                    ok &= !src.uses_direct_io();
+                bytefluo_stream buf(src, bytefluo::big);
+                ok &= buf.size() == vec.size();
+
+                // sequential reads, straddling buffers
+                whole.seek_begin(0);
+                while (whole.tellg() + 15 <= whole.size()) {
+                    uint8_t a, a2;
+                    uint16_t b, b2;
+                    uint32_t c, c2;
+                    uint64_t d, d2;
+                    buf >> a >> b >> c >> d;
+                    whole >> a2 >> b2 >> c2 >> d2;
+                    ok &= a == a2 && b == b2 && c == c2 && d == d2;
+                }
+                uint8_t bytes[30], bytes2[30];
+                const size_t n = whole.size() - whole.tellg();
+                buf.read(bytes, n);
+                whole.read(bytes2, n);
+                ok &= ::memcmp(bytes, bytes2, n) == 0;
+                ok &= buf.eos();
+
+                // random reads, including ones straddling aligned offsets
+                uint64_t r = 88172645463325252ULL;
+                for (int i = 0; i < 100; ++i) {
+                    r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+                    const size_t pos = i % 2 ? size_t(r % (vec.size() - 8))
+                        : size_t(r % 24) * 4096 + 4093;
+                    uint64_t x, y;
+                    buf.seek_begin(pos);
+                    whole.seek_begin(pos);
+                    buf >> x;
+                    whole >> y;
+                    ok &= x == y;
+                }
+
+                // one read() of everything
+                std::vector<uint8_t> all(vec.size());
+                buf.seek_begin(0);
+                buf.read(&all[0], all.size());
+                ok &= all == vec;
+            }
+        }
+    }
+    TEST_EQUAL(ok, true);
+
+    {
+        bytefluo_direct_source src(path.c_str(), 8192);
+        bytefluo_stream buf(src, bytefluo::little);
+        uint16_t x;
+        buf.seek_end(2);
+        buf >> x;
+        TEST_EQUAL(x, vec[100002] << 8 | vec[100001]);
+        TEST_EQUAL(buf.eos(), true);
+        TEST_EXCEPTION(buf >> x, bytefluo_exception::attempt_to_read_past_end);
+        TEST_EXCEPTION(buf.seek_begin(100004), bytefluo_exception::attempt_to_seek_after_end);
+    }
+    ::unlink(path.c_str());
+
+    TEST_EXCEPTION(bytefluo_direct_source(path.c_str()), bytefluo_exception::io_error);
+}
+
+void test_mirrored_ring()
+{
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    bytefluo_mirrored_ring ring(1);
+    TEST_EQUAL(ring.capacity(), page);
+    bytefluo_mirrored_ring ring2(page + 1);
+    TEST_EQUAL(ring2.capacity(), 2 * page);
+
+    std::vector<uint8_t> vec(100000);
+    for (size_t i = 0; i < vec.size(); ++i)
+        vec[i] = uint8_t(i * 7 + i / 256);
+    TEST_EQUAL(pass_through_ring(ring, vec), true);
+    TEST_EQUAL(pass_through_ring(ring2, vec), true);
+
+    // bytes that wrap around the end of the ring are fetched in one piece
+    std::vector<uint8_t> bytes(page + 8);
+    for (size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = uint8_t(i * 13);
+    bytefluo_mirrored_ring ring3(page);
+    bytefluo_ring_source src(ring3);
+    const uint8_t * data;
+    TEST_EQUAL(ring3.write(&bytes[0], page - 4), page - 4);
+    TEST_EQUAL(src.fetch(0, 1, data), page - 4);
+    TEST_EQUAL(src.fetch(page - 8, 1, data), 4);
+    TEST_EQUAL(ring3.write(&bytes[page - 4], 12), 12);
+    TEST_EQUAL(src.fetch(page - 4, 1, data), 12);
+    TEST_EQUAL(::memcmp(data, &bytes[page - 4], 12), 0);
+    ring3.close();
+    TEST_EQUAL(src.fetch(page + 8, 1, data), 0);
+
+    // whereas a ring on the heap must copy them
+    bytefluo_ring ring4(page);
+    bytefluo_ring_source src4(ring4);
+    TEST_EQUAL(ring4.write(&bytes[0], page - 4), page - 4);
+    TEST_EQUAL(src4.fetch(0, 1, data), page - 4);
+    TEST_EQUAL(src4.fetch(page - 8, 1, data), 4);
+    TEST_EQUAL(ring4.write(&bytes[page - 4], 12), 12);
+    TEST_EQUAL(src4.fetch(page - 4, 1, data), 4);
+    TEST_EQUAL(src4.fetch(page - 4, 12, data), 12);
+    TEST_EQUAL(::memcmp(data, &bytes[page - 4], 12), 0);
+}
+
+void test_huge_pages()
+{
+    const size_t huge = bytefluo_huge_pages::page_size;
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    bytefluo_huge_pages::backing how = bytefluo_huge_pages::hugetlb;
+
+    // small allocations have ordinary pages
+    uint8_t * p = static_cast<uint8_t *>(bytefluo_huge_pages::allocate(100, &how));
+    TEST_EQUAL(how, bytefluo_huge_pages::normal);
+    TEST_EQUAL(reinterpret_cast<uintptr_t>(p) % page, 0);
+    TEST_EQUAL(p[0] == 0 && p[99] == 0, true);
+    p[99] = 1;
+    bytefluo_huge_pages::deallocate(p, 100);
+    TEST_EQUAL(bytefluo_huge_pages::allocate(0) == 0, true);
+    bytefluo_huge_pages::deallocate(0, 0);
+
+    // large ones are aligned to huge pages, however they are backed
+    const size_t len = huge + huge / 2;
+    p = static_cast<uint8_t *>(bytefluo_huge_pages::allocate(len, &how));
+    TEST_EQUAL(reinterpret_cast<uintptr_t>(p) % huge, 0);
+    TEST_EQUAL(how == bytefluo_huge_pages::normal
+        || how == bytefluo_huge_pages::transparent
+        || how == bytefluo_huge_pages::hugetlb, true);
+    bool ok = true;
+    for (size_t i = 0; i < len; i += 4096)
+        ok &= p[i] == 0;
+    ::memset(p, 0xA5, len);
+    ok &= p[len - 1] == 0xA5;
+    TEST_EQUAL(ok, true);
+    bytefluo_huge_pages::deallocate(p, len);
+
+    std::vector<uint32_t, bytefluo_huge_allocator<uint32_t> > vec;
+    for (uint32_t i = 0; i < 1000000; ++i)
+        vec.push_back(i * 3);
+    TEST_EQUAL(vec[999999], 2999997u);
+    bool bad_alloc = false;
+    try {
+        bytefluo_huge_allocator<uint32_t>().allocate(SIZE_MAX / 2);
+    }
+    catch (const std::bad_alloc &) {
+        bad_alloc = true;
+    }
+    TEST_EQUAL(bad_alloc, true);
+
+    // a buffer filled by the caller, then shared
+    uint8_t * dest;
+    bytefluo_buffer b(bytefluo_huge_buffer(len, dest));
+    TEST_EQUAL(b.data() == dest, true);
+    TEST_EQUAL(b.size(), len);
+    for (size_t i = 0; i < len; ++i)
+        dest[i] = uint8_t(i * 7 + i / 256);
+    bytefluo_shared buf(b.slice(huge - 2, 4), bytefluo::big);
+    b = bytefluo_buffer();
+    uint32_t x;
+    buf >> x;
+    const size_t i = huge - 2;
+    TEST_EQUAL(x, uint32_t(uint8_t(i * 7 + i / 256)) << 24
+        | uint32_t(uint8_t((i + 1) * 7 + (i + 1) / 256)) << 16
+        | uint32_t(uint8_t((i + 2) * 7 + (i + 2) / 256)) << 8
+        | uint8_t((i + 3) * 7 + (i + 3) / 256));
+    TEST_EQUAL(bytefluo_huge_buffer(0, dest).empty(), true);
+
+    // a file read into huge pages
+    std::vector<uint8_t> bytes(len + 3);
+    for (size_t j = 0; j < bytes.size(); ++j)
+        bytes[j] = uint8_t(j * 13 + j / 1000);
+    const std::string path = make_temp_file(bytes);
+    bytefluo_buffer f(bytefluo_read_huge_buffer(path.c_str(), &how));
+    TEST_EQUAL(f.size(), bytes.size());
+    TEST_EQUAL(::memcmp(f.data(), &bytes[0], bytes.size()), 0);
+    ::unlink(path.c_str());
+    TEST_EXCEPTION(bytefluo_read_huge_buffer(path.c_str()), bytefluo_exception::io_error);
+}
+
+#endif
+
 void test_performance_8(int best_of_attempts, int repeats, size_t bytes_len)
 {
     timer t;
@@ -1523,6 +3851,311 @@ void test_performance_64(int best_of_attempts, int repeats, size_t bytes_len)
         << ")\n";
 }
 
+// compare seek_begin() + read_be() with gather_be() at random offsets
+// into a buffer much larger than the cache
+void test_performance_gather(int best_of_attempts, size_t bytes_len, size_t reads)
+{
+    timer t;
+    uint64_t best_seek_read_ms = 99999999;
+    uint64_t best_gather_ms = 99999999;
+
+    std::vector<uint8_t> bytes(bytes_len);
+    for (size_t b = 0; b < bytes_len; ++b)
+        bytes[b] = uint8_t(b);
+    bytefluo buf(bytefluo_from_vector(bytes, bytefluo::big));
+
+    std::vector<size_t> offsets(reads);
+    uint64_t r = 88172645463325252ULL;
+    for (size_t i = 0; i < reads; ++i) {
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+        offsets[i] = size_t(r % (bytes_len - sizeof(uint32_t)));
+    }
+    std::vector<uint32_t> out(reads);
+
+    for (int attempt = 0; attempt < best_of_attempts; ++attempt) {
+        uint32_t x = 0;
+        t.reset();
+        for (size_t i = 0; i < reads; ++i) {
+            uint32_t v;
+            buf.seek_begin(offsets[i]);
+            buf.read_be(v);
+            x += v;
+        }
+        const uint64_t ms = t.elapsed_ms();
+
+        if (x == ms)
+            std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+        if (ms < best_seek_read_ms)
+            best_seek_read_ms = ms;
+    }
+
+    for (int attempt = 0; attempt < best_of_attempts; ++attempt) {
+        t.reset();
+        buf.gather_be(&offsets[0], reads, &out[0]);
+        const uint64_t ms = t.elapsed_ms();
+
+        uint32_t x = 0;
+        for (size_t i = 0; i < reads; ++i)
+            x += out[i];
+        if (x == ms)
+            std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+        if (ms < best_gather_ms)
+            best_gather_ms = ms;
+    }
+
+    std::cout
+        << "random uint32_t: seek_begin+read_be " << best_seek_read_ms
+        << "ms, gather_be " << best_gather_ms
+        << "ms (x" << double(best_gather_ms)/double(best_seek_read_ms)
+        << ")\n";
+}
+
+// time inet_checksum() over a buffer that fits in the cache
+void test_performance_inet_checksum(int best_of_attempts, int repeats, size_t bytes_len)
+{
+    timer t;
+    uint64_t best_ms = 99999999;
+
+    std::vector<uint8_t> bytes(bytes_len);
+    for (size_t b = 0; b < bytes_len; ++b)
+        bytes[b] = uint8_t(b * 7);
+    bytefluo buf(bytefluo_from_vector(bytes, bytefluo::big));
+
+    for (int attempt = 0; attempt < best_of_attempts; ++attempt) {
+        uint32_t x = 0;
+        t.reset();
+        for (int i = 0; i < repeats; ++i)
+            x += buf.inet_checksum(bytes_len, uint32_t(i));
+        const uint64_t ms = t.elapsed_ms();
+
+        if (x == ms)
+            std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+        if (ms < best_ms)
+            best_ms = ms;
+    }
+
+    std::cout
+        << "inet_checksum " << best_ms << "ms for " << repeats << " x "
+        << bytes_len << " bytes ("
+        << double(bytes_len) * repeats / (best_ms ? best_ms : 1) / 1e6
+        << " GB/s)\n";
+}
+
+// a read function that takes about 'ms_per_call' milliseconds per call,
+// like a slow disk, to return up to 'chunk' bytes of 'total' bytes
+class slow_reader {
+public:
+    slow_reader(size_t total, size_t chunk, int ms_per_call)
+    : total(total), chunk(chunk), ms_per_call(ms_per_call), pos(0)
+    {
+    }
+
+    size_t operator()(void * dest, size_t len)
+    {
+        const size_t n = std::min(std::min(len, chunk), total - pos);
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms_per_call));
+        ::memset(dest, int(pos / chunk + 1), n);
+        pos += n;
+        return n;
+    }
+
+private:
+    size_t total;
+    size_t chunk;
+    int ms_per_call;
+    size_t pos;
+};
+
+// a parse of the data from 'src' that takes a little CPU time per byte
+uint32_t parse_stream(bytefluo_source & src)
+{
+    bytefluo_stream buf(src, bytefluo::big);
+    uint32_t x = 0;
+    while (!buf.eos()) {
+        uint32_t v;
+        buf >> v;
+        for (int i = 0; i < 8; ++i)
+            x = (x ^ v) * 0x01000193;
+    }
+    return x;
+}
+
+void test_performance_readahead(size_t bytes_len, size_t chunk, int ms_per_call)
+{
+    timer t;
+    slow_reader reader(bytes_len, chunk, ms_per_call);
+    bytefluo_reader_source src(reader, chunk);
+    uint32_t x = parse_stream(src);
+    const uint64_t reader_ms = t.elapsed_ms();
+
+    t.reset();
+    slow_reader reader2(bytes_len, chunk, ms_per_call);
+    bytefluo_readahead_source src2(reader2, chunk, 4);
+    x += parse_stream(src2);
+    const uint64_t readahead_ms = t.elapsed_ms();
+
+    if (x == 0)
+        std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+    std::cout
+        << "parse " << bytes_len / (1024 * 1024) << " MiB read in "
+        << chunk / 1024 << " KiB chunks at " << ms_per_call << " ms per chunk: "
+        << "reader source " << reader_ms << " ms, "
+        << "read-ahead source " << readahead_ms << " ms\n";
+}
+
+#if !defined(_WIN32)
+// time a scan of a 'bytes_len' byte file, and 'reads' random reads from
+// it in prefetched batches, via bytefluo_uring_source with and without
+// io_uring; note that the file will probably be in the page cache
+void test_performance_uring(size_t bytes_len, size_t reads)
+{
+    std::vector<uint8_t> bytes(bytes_len);
+    for (size_t b = 0; b < bytes_len; ++b)
+        bytes[b] = uint8_t(b);
+    const std::string path = make_temp_file(bytes);
+    std::vector<uint64_t> offsets(reads);
+    uint64_t r = 88172645463325252ULL;
+    for (size_t i = 0; i < reads; ++i) {
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+        offsets[i] = r % (bytes_len - sizeof(uint32_t));
+    }
+
+    timer t;
+    for (int use_io_uring = 0; use_io_uring < 2; ++use_io_uring) {
+        bytefluo_uring_source src(path.c_str(), 256 * 1024, 16, use_io_uring != 0);
+        bytefluo_stream buf(src, bytefluo::big);
+        uint32_t x = 0;
+        t.reset();
+        while (!buf.eos()) {
+            uint32_t v;
+            buf >> v;
+            x += v;
+        }
+        const uint64_t scan_ms = t.elapsed_ms();
+
+        bytefluo_uring_source src2(path.c_str(), 4096, 16, use_io_uring != 0);
+        bytefluo_stream buf2(src2, bytefluo::big);
+        t.reset();
+        for (size_t i = 0; i + 16 <= reads; i += 16) {
+            src2.prefetch(&offsets[i], 16);
+            for (size_t j = i; j < i + 16; ++j) {
+                uint32_t v;
+                buf2.seek_begin(offsets[j]);
+                buf2 >> v;
+                x += v;
+            }
+        }
+        const uint64_t random_ms = t.elapsed_ms();
+
+        if (x == scan_ms)
+            std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+        std::cout
+            << "bytefluo_uring_source " << (src.uses_io_uring() ? "with" : "without")
+            << " io_uring: scan " << bytes_len / (1024 * 1024) << " MiB "
+            << scan_ms << " ms, " << reads << " random reads " << random_ms << " ms\n";
+    }
+    ::unlink(path.c_str());
+}
+#endif
+
+#if !defined(_WIN32)
+// time a scan of a 'bytes_len' byte file via bytefluo_fd_source, which
+// uses buffered reads, and via bytefluo_direct_source; note that the
+// buffered reads will probably be served from the page cache
+void test_performance_direct(size_t bytes_len)
+{
+    std::vector<uint8_t> bytes(bytes_len);
+    for (size_t b = 0; b < bytes_len; ++b)
+        bytes[b] = uint8_t(b);
+    const std::string path = make_temp_file(bytes);
+
+    timer t;
+    uint32_t x = 0;
+    for (int kind = 0; kind < 3; ++kind) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        bytefluo_fd_source fd_src(fd, 1024 * 1024);
+        bytefluo_direct_source direct_src(path.c_str(), 1024 * 1024, kind == 2);
+        bytefluo_source & src = kind == 0
+            ? static_cast<bytefluo_source &>(fd_src) : direct_src;
+        bytefluo_stream buf(src, bytefluo::big);
+        t.reset();
+        while (!buf.eos()) {
+            uint32_t v;
+            buf >> v;
+            x += v;
+        }
+        const uint64_t ms = t.elapsed_ms();
+        ::close(fd);
+
+        const char * const names[3] = {
+            "buffered reads", "O_DIRECT reads", "double-buffered O_DIRECT reads"
+        };
+        std::cout
+            << "scan " << bytes_len / (1024 * 1024) << " MiB with " << names[kind]
+            << (kind && !direct_src.uses_direct_io() ? " (O_DIRECT unsupported)" : "")
+            << ": " << ms << " ms\n";
+    }
+    if (x == 1)
+        std::cout << "an attempt to stop the compiler optimising away the test code\n";
+    ::unlink(path.c_str());
+}
+
+void test_performance_huge_pages(size_t bytes_len, size_t reads)
+{
+    std::vector<size_t> offsets(reads);
+    uint64_t r = 88172645463325252ULL;
+    for (size_t i = 0; i < reads; ++i) {
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17; // xorshift64
+        offsets[i] = size_t(r % (bytes_len - sizeof(uint32_t)));
+    }
+
+    timer t;
+    for (int huge = 0; huge < 2; ++huge) {
+        // the same bytes, in ordinary heap memory or in huge pages
+        bytefluo_huge_pages::backing how = bytefluo_huge_pages::normal;
+        bytefluo_buffer b;
+        uint8_t * dest;
+        if (huge)
+            b = bytefluo_huge_buffer(bytes_len, dest, &how);
+        else {
+            std::vector<uint8_t> vec(bytes_len);
+            dest = &vec[0];
+            b = bytefluo_buffer(std::move(vec));
+        }
+        for (size_t i = 0; i < bytes_len; ++i)
+            dest[i] = uint8_t(i / 4093 + 1);
+        bytefluo_shared buf(b, bytefluo::big);
+
+        uint32_t x = 0;
+        t.reset();
+        for (size_t i = 0; i < reads; ++i) {
+            uint32_t v;
+            buf.seek_begin(offsets[i]);
+            buf.read_be(v);
+            x += v;
+        }
+        const uint64_t ms = t.elapsed_ms();
+
+        if (x == ms)
+            std::cout << "an attempt to stop the compiler optimising away the test code\n";
+
+        static const char * const names[3] = {
+            "ordinary pages", "transparent huge pages", "MAP_HUGETLB pages"
+        };
+        std::cout
+            << "bytefluo_shared over " << bytes_len / (1024 * 1024) << " MiB in "
+            << (huge ? names[how] : "heap memory") << ": "
+            << reads << " random seek_begin + read_be " << ms << " ms\n";
+    }
+}
+
+#endif
+
 void test_performance()
 {
     std::cout << "timing..." << std::endl;
@@ -1537,7 +4170,14 @@ void test_performance()
     test_performance_16(best_of_attempts, repeats, bytes_len);
     test_performance_32(best_of_attempts, repeats, bytes_len);
     test_performance_64(best_of_attempts, repeats, bytes_len);
-
+    test_performance_gather(best_of_attempts, 256 * 1024 * 1024, 10 * 1000 * 1000);
+    test_performance_inet_checksum(best_of_attempts, repeats, bytes_len);
+    test_performance_readahead(64 * 1024 * 1024, 1024 * 1024, 10);
+#if !defined(_WIN32)
+    test_performance_uring(256 * 1024 * 1024, 1000 * 1000);
+    test_performance_direct(256 * 1024 * 1024);
+    test_performance_huge_pages(1024 * 1024 * 1024, 20 * 1000 * 1000);
+#endif
 }
 
 
@@ -1555,6 +4195,37 @@ int main()
         test_assignment();
         test_ctor_exceptions();
         test_more_or_less_real_world_example();
+        test_read_utf16();
+        test_decoding_source();
+        test_resync();
+        test_find_value();
+        test_array_view();
+        test_reduce();
+        test_scan();
+        test_gather();
+        test_block_lower_bound();
+        test_keys();
+        test_hash();
+        test_crc();
+        test_inet_checksum();
+        test_mismatch();
+        test_decode_dictionary();
+        test_decode_rle();
+        test_segmented_source();
+        test_reader_source();
+        test_readahead_source();
+        test_ring_source();
+        test_buffer();
+#if !defined(_WIN32)
+        test_file();
+        test_map_buffer();
+        test_fd_source();
+        test_uring_source();
+        test_paged_source();
+        test_direct_source();
+        test_mirrored_ring();
+        test_huge_pages();
+#endif
     }
     catch (const std::exception & e) {
         std::cout << "unexpected exception: " << e.what() << '\n';
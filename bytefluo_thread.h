@@ -0,0 +1,495 @@
+#ifndef BYTEFLUO_THREAD_H_INCLUDED
+#define BYTEFLUO_THREAD_H_INCLUDED
+
+/*  bytefluo is distributed under the MIT License:
+
+        MIT License
+
+        Copyright (c) 2008,2009,2010,2016,2017 Anthony C. Hay
+
+        Permission is hereby granted, free of charge, to any person obtaining a copy
+        of this software and associated documentation files (the "Software"), to deal
+        in the Software without restriction, including without limitation the rights
+        to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+        copies of the Software, and to permit persons to whom the Software is
+        furnished to do so, subject to the following conditions:
+
+        The above copyright notice and this permission notice shall be included in all
+        copies or substantial portions of the Software.
+
+        THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+        IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+        FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+        AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+        LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+        OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+        SOFTWARE.
+
+    Purpose:
+    bytefluo classes that use a second thread to supply the data, via
+    the C++11 thread library. This header is not needed by programs
+    that don't use them; on some systems programs that do must be
+    linked with -pthread. */
+
+#include "bytefluo.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+// a bytefluo_source that reads its bytes, in order, from a function such
+// as a wrapper around read(2) on a thread of its own, keeping up to
+// 'depth' buffers of up to 'buffer_size' bytes filled ahead of the reader
+// so that reading the data overlaps with parsing it
+class bytefluo_readahead_source : public bytefluo_source {
+public:
+    typedef bytefluo_reader_source::read_function read_function;
+
+    // bytes will be read from 'read' on a separate thread
+    bytefluo_readahead_source(read_function read, size_t buffer_size = 1024 * 1024,
+        size_t depth = 4)
+    : read(read), slots(depth < 2 ? 2 : depth), head(0), tail(0), stop(false),
+      reader_waiting(false), io_waiting(false), have_slot(false), slot_pos(0), scratch_pos(0)
+    {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i].data.resize(buffer_size ? buffer_size : 1);
+            slots[i].len = 0;
+        }
+        io_thread = std::thread(&bytefluo_readahead_source::run, this);
+    }
+
+    // stop the I/O thread, waiting for any read in progress to return
+    ~bytefluo_readahead_source()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+        io_thread.join();
+    }
+
+    virtual uint64_t size()
+    {
+        return unknown_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        const size_t wanted = min_len ? min_len : 1;
+        if (!have_slot)
+            next_slot();
+
+        // bytes before the current buffer remain only in the scratch buffer
+        if (pos < slot_pos) {
+            if (pos < scratch_pos || scratch_pos + scratch.size() < slot_pos)
+                throw bytefluo_exception(
+                    bytefluo_exception::seek_not_supported,
+                    "bytefluo: source can't seek backwards");
+            const size_t offset = static_cast<size_t>(pos - scratch_pos);
+            if (scratch.size() - offset >= wanted) {
+                data = &scratch[0] + offset;
+                return scratch.size() - offset;
+            }
+            std::vector<uint8_t> prefix(scratch.begin() + offset,
+                scratch.begin() + static_cast<size_t>(slot_pos - scratch_pos));
+            return assemble(pos, prefix, 0, wanted, data);
+        }
+
+        // release whole buffers until 'pos' is in the current buffer
+        while (current().len != 0 && pos >= slot_pos + current().len)
+            next_slot();
+        const slot & s = current();
+        if (s.error)
+            std::rethrow_exception(s.error);
+        if (s.len == 0) {
+            if (pos != slot_pos)
+                throw bytefluo_exception(
+                    bytefluo_exception::attempt_to_seek_after_end,
+                    "bytefluo: attempt to seek after end of data");
+            data = 0;
+            return 0;
+        }
+
+        // the fast path: the bytes at 'pos' are contiguous in the buffer
+        const size_t offset = static_cast<size_t>(pos - slot_pos);
+        if (s.len - offset >= wanted) {
+            data = &s.data[0] + offset;
+            return s.len - offset;
+        }
+        std::vector<uint8_t> prefix;
+        return assemble(pos, prefix, offset, wanted, data);
+    }
+
+private:
+    struct slot {
+        std::vector<uint8_t> data;
+        size_t len;                 // 0 at the end of the data
+        std::exception_ptr error;   // what 'read' threw, if anything
+    };
+
+    read_function read;
+    std::vector<slot> slots;
+
+    // slots are filled in turn by the I/O thread; 'head' counts the slots
+    // filled and 'tail' the slots released by the reader, so slots
+    // [tail, head) (modulo slots.size()) hold data; each index is written
+    // by one thread only, and the acquire/release ordering of the atomic
+    // indices publishes the slot contents, so no lock is taken to hand
+    // over a slot; the mutex and condition variable are used only to sleep
+    // when the queue is empty or full, and a thread that has changed an
+    // index takes the mutex to wake the other only if its flag shows it
+    // is asleep
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic<bool> stop;     // set, with mutex held, to end the I/O thread
+    std::atomic<bool> reader_waiting; // the reader is waiting for 'head' to change
+    std::atomic<bool> io_waiting;     // the I/O thread is waiting for 'tail' to change
+    std::thread io_thread;
+
+    // reader state; slot 'tail' is the current slot iff have_slot is true
+    bool have_slot;
+    uint64_t slot_pos;          // stream offset of the current slot's first byte
+    std::vector<uint8_t> scratch; // bytes assembled from adjacent slots
+    uint64_t scratch_pos;       // stream offset of scratch[0]
+
+    const slot & current() const
+    {
+        return slots[tail.load(std::memory_order_relaxed) % slots.size()];
+    }
+
+    // having changed 'head' or 'tail', wake the other thread if 'waiting',
+    // its flag, shows it may be asleep; the fence here and the one in
+    // wait() ensure that either the other thread sees the new index before
+    // it sleeps or this thread sees its flag set
+    void notify(std::atomic<bool> & waiting)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            cond.notify_all();
+        }
+    }
+
+    // sleep until 'ready' returns true, with 'waiting' set meanwhile
+    template <typename predicate>
+    void wait(std::atomic<bool> & waiting, predicate ready)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cond.wait(lock, ready);
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    // release the current slot, if any, and make the next slot current,
+    // waiting for the I/O thread to fill it; rethrow any read error
+    const slot & next_slot()
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        if (have_slot) {
+            slot_pos += slots[t % slots.size()].len;
+            tail.store(++t, std::memory_order_release);
+            have_slot = false;
+            notify(io_waiting);
+        }
+        if (head.load(std::memory_order_acquire) == t)
+            wait(reader_waiting, [&] { return head.load(std::memory_order_acquire) != t; });
+        have_slot = true;
+        const slot & s = slots[t % slots.size()];
+        if (s.error)
+            std::rethrow_exception(s.error);
+        return s;
+    }
+
+    // copy 'prefix' followed by the bytes at 'offset' in the current slot
+    // and the following slots into the scratch buffer until it holds
+    // 'wanted' bytes or the data ends; point 'data' at the scratch buffer,
+    // which will hold the bytes from stream offset 'pos', and return its size
+    size_t assemble(uint64_t pos, std::vector<uint8_t> & prefix, size_t offset,
+        size_t wanted, const uint8_t *& data)
+    {
+        scratch.swap(prefix);
+        scratch_pos = pos;
+        const slot * s = &current();
+        for (;;) {
+            if (s->error)
+                std::rethrow_exception(s->error);
+            const size_t n = std::min(wanted - scratch.size(), s->len - offset);
+            scratch.insert(scratch.end(), s->data.begin() + offset, s->data.begin() + offset + n);
+            if (scratch.size() == wanted || s->len == 0)
+                break;
+            s = &next_slot();
+            offset = 0;
+        }
+        data = scratch.empty() ? 0 : &scratch[0];
+        return scratch.size();
+    }
+
+    // the I/O thread: fill each free slot in turn until the data ends,
+    // 'read' throws or the source is destroyed
+    void run()
+    {
+        for (uint64_t h = 0; ; ++h) {
+            if (h - tail.load(std::memory_order_acquire) == slots.size())
+                wait(io_waiting, [&] {
+                    return stop || h - tail.load(std::memory_order_acquire) < slots.size();
+                });
+            if (stop)
+                return;
+            slot & s = slots[h % slots.size()];
+            s.len = 0;
+            s.error = std::exception_ptr();
+            try {
+                const size_t n = read(&s.data[0], s.data.size());
+                if (n > s.data.size())
+                    throw bytefluo_exception(bytefluo_exception::invalid_argument,
+                        "bytefluo: read function returned too many bytes");
+                s.len = n;
+            }
+            catch (...) {
+                s.error = std::current_exception();
+            }
+            head.store(h + 1, std::memory_order_release);
+            notify(reader_waiting);
+            if (s.len == 0)
+                return; // the end of the data, or an error
+        }
+    }
+};
+
+
+// a single-producer, single-consumer lock-free ring buffer of bytes: one
+// thread may write() bytes while another reads them through a
+// bytefluo_ring_source, without copying them out of the ring
+class bytefluo_ring {
+public:
+    // the ring will hold up to 'capacity' bytes
+    explicit bytefluo_ring(size_t capacity)
+    : heap(capacity ? capacity : 1), buf(&heap[0]), cap(heap.size()), mirrored(false),
+      cached_read(0), cached_write(0)
+    {
+        write_pos = 0;
+        read_pos = 0;
+        is_closed = false;
+        consumer_waiting = false;
+    }
+
+    virtual ~bytefluo_ring()
+    {
+    }
+
+    size_t capacity() const
+    {
+        return cap;
+    }
+
+    // producer: copy as many of the 'len' bytes at 'src' as there is room
+    // for into the ring; return the number copied
+    size_t write(const void * src, size_t len)
+    {
+        uint8_t * dest;
+        size_t done = 0;
+        // at most two pieces: up to the end of the storage, then from its start
+        for (int piece = 0; piece < 2 && done < len; ++piece) {
+            const size_t n = std::min(len - done, prepare(dest));
+            if (n == 0)
+                break;
+            ::memcpy(dest, static_cast<const uint8_t *>(src) + done, n);
+            commit(n);
+            done += n;
+        }
+        return done;
+    }
+
+    // producer: set 'dest' to the free space at the write position and
+    // return the number of bytes that may be written there contiguously,
+    // e.g. by recv(); then call commit() with the number written
+    size_t prepare(uint8_t *& dest)
+    {
+        const uint64_t w = write_pos.load(std::memory_order_relaxed);
+        if (w - cached_read == cap)
+            cached_read = read_pos.load(std::memory_order_acquire);
+        const size_t free_len = cap - static_cast<size_t>(w - cached_read);
+        const size_t offset = static_cast<size_t>(w % cap);
+        dest = buf + offset;
+        return mirrored ? free_len : std::min(free_len, cap - offset);
+    }
+
+    // producer: make 'n' bytes written at the address given by prepare()
+    // available to the consumer
+    void commit(size_t n)
+    {
+        write_pos.store(write_pos.load(std::memory_order_relaxed) + n,
+            std::memory_order_release);
+        wake_consumer();
+    }
+
+    // producer: mark the end of the data; no more bytes may be written
+    void close()
+    {
+        is_closed.store(true, std::memory_order_release);
+        wake_consumer();
+    }
+
+protected:
+    // the ring will use the 'capacity' bytes at 'storage'; if 'mirror'
+    // is true they must also be mapped immediately after themselves
+    bytefluo_ring(uint8_t * storage, size_t capacity, bool mirror)
+    : buf(storage), cap(capacity), mirrored(mirror), cached_read(0), cached_write(0)
+    {
+        write_pos = 0;
+        read_pos = 0;
+        is_closed = false;
+        consumer_waiting = false;
+    }
+
+    uint8_t * storage() const
+    {
+        return buf;
+    }
+
+private:
+    friend class bytefluo_ring_source;
+
+    std::vector<uint8_t> heap;      // the storage, unless given to the constructor
+    uint8_t * buf;
+    size_t cap;
+    bool mirrored;
+
+    // the positions are counts of bytes written and released, so the
+    // bytes [read_pos, write_pos) are readable; each is stored by one
+    // thread only, with release ordering, and loaded by the other with
+    // acquire ordering; each thread keeps a copy of the other's position
+    // next to its own and reloads it only when it must; the padding keeps
+    // the fields each thread writes off the cache lines holding the
+    // other thread's fields and the fields both only read
+    char pad0[64];
+    std::atomic<uint64_t> write_pos;
+    uint64_t cached_read;           // producer's copy of read_pos
+    char pad1[64];
+    std::atomic<uint64_t> read_pos;
+    uint64_t cached_write;          // consumer's copy of write_pos
+    char pad2[64];
+    std::atomic<bool> is_closed;
+
+    // a consumer that has found no bytes for a while sleeps on 'cond',
+    // having set 'consumer_waiting' with 'mutex' held; the producer takes
+    // the mutex to wake it only if the flag is set
+    std::atomic<bool> consumer_waiting;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    // the number of times the consumer yields before it sleeps
+    enum { spin_limit = 64 };
+
+    // producer: having changed write_pos or is_closed, wake the consumer
+    // if it may be asleep; the fence here and the one in wait_for_write()
+    // ensure that either the consumer sees the change before it sleeps or
+    // the producer sees its flag set
+    void wake_consumer()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumer_waiting.load(std::memory_order_relaxed)) {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            cond.notify_all();
+        }
+    }
+
+    // consumer: sleep until write_pos is no longer 'w' or the ring is closed
+    void wait_for_write(uint64_t w)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        consumer_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cond.wait(lock, [&] {
+            return write_pos.load(std::memory_order_acquire) != w
+                || is_closed.load(std::memory_order_acquire);
+        });
+        consumer_waiting.store(false, std::memory_order_relaxed);
+    }
+};
+
+
+// a bytefluo_source that supplies the bytes written to a bytefluo_ring,
+// in order; reads wait for the producer to write the bytes, until it
+// closes the ring
+class bytefluo_ring_source : public bytefluo_source {
+public:
+    // the bytes will be read from 'ring', which must outlive the source;
+    // there must be only one reader of the ring
+    explicit bytefluo_ring_source(bytefluo_ring & ring)
+    : ring(&ring)
+    {
+    }
+
+    virtual uint64_t size()
+    {
+        return unknown_size;
+    }
+
+    virtual size_t fetch(uint64_t pos, size_t min_len, const uint8_t *& data)
+    {
+        bytefluo_ring & r = *ring;
+        if (pos < r.read_pos.load(std::memory_order_relaxed))
+            throw bytefluo_exception(
+                bytefluo_exception::seek_not_supported,
+                "bytefluo: source can't seek backwards");
+
+        // release the bytes before 'pos' to the producer, then wait for
+        // the bytes wanted to be written, or for the ring to be closed
+        const size_t wanted = min_len ? min_len : 1;
+        uint64_t w = r.cached_write;
+        for (int spins = 0; ; ++spins) {
+            if (pos <= w && w - pos >= wanted)
+                break;
+            const bool closed = r.is_closed.load(std::memory_order_acquire);
+            w = r.cached_write = r.write_pos.load(std::memory_order_acquire);
+            const uint64_t release = pos < w ? pos : w;
+            if (release > r.read_pos.load(std::memory_order_relaxed))
+                r.read_pos.store(release, std::memory_order_release);
+            if (pos <= w && w - pos >= wanted)
+                break;
+            if (closed) {
+                if (pos > w)
+                    throw bytefluo_exception(
+                        bytefluo_exception::attempt_to_seek_after_end,
+                        "bytefluo: attempt to seek after end of data");
+                break;
+            }
+            if (spins < bytefluo_ring::spin_limit)
+                std::this_thread::yield();
+            else
+                r.wait_for_write(w);
+        }
+        if (pos > r.read_pos.load(std::memory_order_relaxed))
+            r.read_pos.store(pos, std::memory_order_release);
+
+        // the bytes [pos, w) are readable; they wrap around the end of the
+        // storage unless it is mirrored
+        const size_t avail = static_cast<size_t>(w - pos);
+        const size_t offset = static_cast<size_t>(pos % r.cap);
+        const size_t contiguous = r.mirrored ? avail : std::min(avail, r.cap - offset);
+        if (contiguous >= wanted || contiguous == avail) {
+            data = avail ? r.buf + offset : 0;
+            return contiguous;
+        }
+        const size_t n = std::min(wanted, avail);
+        scratch.assign(r.buf + offset, r.buf + r.cap);
+        scratch.insert(scratch.end(), r.buf, r.buf + (n - scratch.size()));
+        data = &scratch[0];
+        return scratch.size();
+    }
+
+private:
+    bytefluo_ring * ring;
+    std::vector<uint8_t> scratch;
+};
+
+
+#endif //#ifdef BYTEFLUO_THREAD_H_INCLUDED